@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "pong.h"
+#include "pong_tools.h"
+
+/*
+ * runs the engine headless over a matrix of terminal sizes and entity
+ * counts and reads hardware counters around each phase of a frame.
+ * counters the kernel won't give us (no pmu, perf_event_paranoid, a vm)
+ * are left out and shown as -, wall time is always there.
+ */
+typedef enum {
+	COUNTER_CYCLES,
+	COUNTER_INSTRUCTIONS,
+	COUNTER_BRANCH_MISSES,
+	COUNTER_L1D_MISSES,
+	COUNTER_LLC_MISSES,
+	COUNTER_COUNT,
+} counter_t;
+
+#define CACHE_READ_MISS(cache) \
+	((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct {
+	uint32_t type;
+	uint64_t config;
+} counter_events[COUNTER_COUNT] = {
+	[COUNTER_CYCLES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	[COUNTER_INSTRUCTIONS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	[COUNTER_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	[COUNTER_L1D_MISSES] = { PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D) },
+	[COUNTER_LLC_MISSES] = { PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL) },
+};
+
+typedef struct {
+	int fd[COUNTER_COUNT];
+	int open;
+} counters_t;
+
+typedef struct {
+	uint64_t ns;
+	uint64_t value[COUNTER_COUNT];
+} sample_t;
+
+typedef enum {
+	PHASE_MOVE,
+	PHASE_RASTER,
+	PHASE_ENCODE,
+	PHASE_COUNT,
+} phase_t;
+
+static const char *const phase_names[PHASE_COUNT] = {
+	[PHASE_MOVE] = "move",
+	[PHASE_RASTER] = "raster",
+	[PHASE_ENCODE] = "diff+encode",
+};
+
+static int perf_event_open(struct perf_event_attr *attr, const pid_t pid, const int cpu, const int group, const unsigned long flags) {
+	return syscall(SYS_perf_event_open, attr, pid, cpu, group, flags);
+}
+
+static void counters_open(counters_t *c) {
+	c->open = 0;
+
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		struct perf_event_attr attr = {
+			.size = sizeof(attr),
+			.type = counter_events[i].type,
+			.config = counter_events[i].config,
+			.exclude_kernel = 1,
+			.exclude_hv = 1,
+		};
+
+		/* separate events rather than a group, so one the pmu lacks doesn't sink the rest */
+		c->fd[i] = perf_event_open(&attr, 0, -1, -1, 0);
+		if (c->fd[i] < 0)
+			continue;
+
+		ioctl(c->fd[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(c->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+		c->open++;
+	}
+}
+
+static void counters_close(counters_t *c) {
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		if (c->fd[i] >= 0)
+			close(c->fd[i]);
+	}
+}
+
+static inline void counters_read(const counters_t *c, sample_t *s) {
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		if (c->fd[i] < 0 || read(c->fd[i], &s->value[i], sizeof(uint64_t)) != sizeof(uint64_t))
+			s->value[i] = 0;
+	}
+
+	s->ns = now_ns();
+}
+
+static inline void sample_add(sample_t *total, const sample_t *start, const sample_t *end) {
+	total->ns += end->ns - start->ns;
+	for (int i = 0; i < COUNTER_COUNT; i++)
+		total->value[i] += end->value[i] - start->value[i];
+}
+
+static void print_counter(const counters_t *c, const counter_t i, const sample_t *s, const int frames) {
+	if (c->fd[i] < 0)
+		printf(" %10s", "-");
+	else
+		printf(" %10.0f", (double)s->value[i] / frames);
+}
+
+static void print_phase(const counters_t *c, const phase_t p, const sample_t *s, const int frames) {
+	printf("  %-12s %10.0f", phase_names[p], (double)s->ns / frames);
+
+	print_counter(c, COUNTER_CYCLES, s, frames);
+	print_counter(c, COUNTER_INSTRUCTIONS, s, frames);
+
+	if (c->fd[COUNTER_CYCLES] < 0 || c->fd[COUNTER_INSTRUCTIONS] < 0 || !s->value[COUNTER_CYCLES])
+		printf(" %6s", "-");
+	else
+		printf(" %6.2f", (double)s->value[COUNTER_INSTRUCTIONS] / s->value[COUNTER_CYCLES]);
+
+	print_counter(c, COUNTER_BRANCH_MISSES, s, frames);
+	print_counter(c, COUNTER_L1D_MISSES, s, frames);
+	print_counter(c, COUNTER_LLC_MISSES, s, frames);
+	putchar('\n');
+}
+
+static void bench(const counters_t *c, const int width, const int height, const uint32_t entities, const int frames) {
+	pong_ctx_t *ctx = pong_new(width, height, 1);
+	assert_ok(!ctx, "couldn't create a %dx%d field", width, height);
+	pong_spawn(ctx, entities > 0 ? entities - 1 : 0);
+
+	/* one frame to get the caches warm and the first full redraw out of the way */
+	pong_tick(ctx);
+	pong_compose(ctx);
+	pong_encode(ctx);
+
+	sample_t total[PHASE_COUNT] = { 0 };
+	uint64_t bytes = 0;
+
+	for (int f = 0; f < frames; f++) {
+		sample_t s[PHASE_COUNT + 1];
+
+		counters_read(c, &s[0]);
+		pong_tick(ctx);
+		counters_read(c, &s[1]);
+		pong_compose(ctx);
+		counters_read(c, &s[2]);
+		bytes += pong_encode(ctx);
+		counters_read(c, &s[3]);
+
+		for (int p = 0; p < PHASE_COUNT; p++)
+			sample_add(&total[p], &s[p], &s[p + 1]);
+	}
+
+	printf("%d x %d, %u entities, %lu bytes/frame\n", width, height, ctx->pool.count, (unsigned long)(bytes / frames));
+	for (int p = 0; p < PHASE_COUNT; p++)
+		print_phase(c, p, &total[p], frames);
+
+	pong_free(ctx);
+}
+
+static const struct {
+	int width, height;
+} sizes[] = {
+	{ 80, 24 },
+	{ 200, 60 },
+	{ 400, 120 },
+};
+
+static const uint32_t entity_counts[] = { 1, 1000, 100000 };
+
+int main(int argc, char **argv) {
+	int frames = 200;
+
+	for (int opt; (opt = getopt(argc, argv, "n:")) != -1;) {
+		switch (opt) {
+		case 'n': frames = atoi(optarg); break;
+		default: die("usage: %s [-n frames]", argv[0]);
+		}
+	}
+
+	assert_ok(frames < 1, "need at least one frame");
+
+	counters_t c;
+	counters_open(&c);
+
+	if (!c.open)
+		printf("hardware counters unavailable (check perf_event_paranoid), wall time only\n");
+	else if (c.open < COUNTER_COUNT)
+		printf("some hardware counters unavailable, shown as -\n");
+
+	printf("per frame, %d frames each\n", frames);
+	printf("  %-12s %10s %10s %10s %6s %10s %10s %10s\n",
+			"phase", "ns", "cycles", "instrs", "ipc", "br-miss", "l1d-miss", "llc-miss");
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		for (size_t e = 0; e < sizeof(entity_counts) / sizeof(entity_counts[0]); e++)
+			bench(&c, sizes[s].width, sizes[s].height, entity_counts[e], frames);
+	}
+
+	counters_close(&c);
+}
@@ -0,0 +1,426 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pong.h"
+#include "pong_tools.h"
+
+/*
+ * the vec2 functions under different scalar types, and rotation through
+ * libm, a sine table or cordic. each is timed over the same random inputs
+ * and compared against pong.h's own long double vec2_add, vec2_sub,
+ * vec2_negate, vec2_len and vec2_rotate, which are timed first. max error
+ * is in cells, for rotations against the unrounded long double result, and
+ * `rounded` counts results that round to a different cell than
+ * vec2_rotate's, which is what the game actually uses.
+ */
+#define INPUTS		4096
+#define INPUT_RANGE	100.0L
+
+#define LUT_SIZE	4096
+#define LUT_MASK	(LUT_SIZE - 1)
+
+#define FIX_SHIFT	16
+#define FIX_ONE		(1 << FIX_SHIFT)
+#define ANGLE_SHIFT	30
+
+typedef struct {
+	vec2 a[INPUTS], b[INPUTS];
+	f64 degrees[INPUTS];
+
+	vec2 add[INPUTS], sub[INPUTS], negate[INPUTS];
+	f64 len[INPUTS];
+	vec2 rotated[INPUTS];
+	vec2 exact[INPUTS];
+} inputs_t;
+
+static inputs_t in;
+
+typedef struct {
+	const char *backend;
+	const char *op;
+	double mops;
+	f64 max_error;
+	int rounded;
+	bool rotation;
+} report_t;
+
+static int reps = 200;
+
+/* every backend's results go here after timing, to be checked in long double */
+static f64 got_x[INPUTS], got_y[INPUTS];
+
+static void inputs_init(void) {
+	srand(1);
+
+	for (int i = 0; i < INPUTS; i++) {
+		in.a[i].x = (rand() / (f64)RAND_MAX * 2 - 1) * INPUT_RANGE;
+		in.a[i].y = (rand() / (f64)RAND_MAX * 2 - 1) * INPUT_RANGE;
+		in.b[i].x = (rand() / (f64)RAND_MAX * 2 - 1) * INPUT_RANGE;
+		in.b[i].y = (rand() / (f64)RAND_MAX * 2 - 1) * INPUT_RANGE;
+		in.degrees[i] = rand() / (f64)RAND_MAX * 360;
+
+		const vec2 v = in.a[i];
+		const f64 radians = in.degrees[i] * M_PI/180;
+
+		in.add[i] = vec2_add(v, in.b[i]);
+		in.sub[i] = vec2_sub(v, in.b[i]);
+		in.negate[i] = vec2_negate(v);
+		in.len[i] = vec2_len(v);
+		in.rotated[i] = vec2_rotate(v, in.degrees[i]);
+		in.exact[i].x = cosl(radians) * v.x - sinl(radians) * v.y;
+		in.exact[i].y = sinl(radians) * v.x + cosl(radians) * v.y;
+	}
+}
+
+static void report(const report_t *r) {
+	printf("  %-12s %-16s %10.1f %12.3Le", r->backend, r->op, r->mops, r->max_error);
+	if (r->rotation)
+		printf(" %8d", r->rounded);
+	putchar('\n');
+}
+
+static inline f64 error_of(const f64 got, const f64 want) {
+	return fabsl(got - want);
+}
+
+/* times `body` over every input for `reps` passes, i is the input index */
+#define TIMED(mops, body) \
+	do { \
+		const uint64_t start = now_ns(); \
+		for (int r = 0; r < reps; r++) \
+			for (int i = 0; i < INPUTS; i++) { body; } \
+		(mops) = (double)reps * INPUTS * 1e3 / (now_ns() - start); \
+	} while (0)
+
+/* got_x/got_y against a vector result */
+static void report_vector(const char *backend, const char *op, const double mops, const vec2 *want) {
+	report_t r = { backend, op, mops, 0, 0, false };
+
+	for (int i = 0; i < INPUTS; i++)
+		r.max_error = fmaxl(r.max_error, fmaxl(error_of(got_x[i], want[i].x), error_of(got_y[i], want[i].y)));
+
+	report(&r);
+}
+
+/* got_x against vec2_len */
+static void report_length(const char *backend, const char *op, const double mops) {
+	report_t r = { backend, op, mops, 0, 0, false };
+
+	for (int i = 0; i < INPUTS; i++)
+		r.max_error = fmaxl(r.max_error, error_of(got_x[i], in.len[i]));
+
+	report(&r);
+}
+
+static void report_rotation(const char *backend, const char *op, const double mops) {
+	report_t r = { backend, op, mops, 0, 0, true };
+
+	for (int i = 0; i < INPUTS; i++) {
+		const f64 ex = error_of(got_x[i], in.exact[i].x);
+		const f64 ey = error_of(got_y[i], in.exact[i].y);
+		r.max_error = fmaxl(r.max_error, fmaxl(ex, ey));
+		r.rounded += roundl(got_x[i]) != in.rotated[i].x || roundl(got_y[i]) != in.rotated[i].y;
+	}
+
+	report(&r);
+}
+
+/* the game's own functions, the baseline everything else is held to */
+static vec2 pong_out[INPUTS];
+static f64 pong_len[INPUTS];
+
+static void collect_vec2(const vec2 *v) {
+	for (int i = 0; i < INPUTS; i++)
+		got_x[i] = v[i].x, got_y[i] = v[i].y;
+}
+
+static void pong_bench(void) {
+	double mops;
+
+	TIMED(mops, pong_out[i] = vec2_add(in.a[i], in.b[i]));
+	collect_vec2(pong_out);
+	report_vector("pong.h", "add", mops, in.add);
+
+	TIMED(mops, pong_out[i] = vec2_sub(in.a[i], in.b[i]));
+	collect_vec2(pong_out);
+	report_vector("pong.h", "sub", mops, in.sub);
+
+	TIMED(mops, pong_out[i] = vec2_negate(in.a[i]));
+	collect_vec2(pong_out);
+	report_vector("pong.h", "negate", mops, in.negate);
+
+	TIMED(mops, pong_len[i] = vec2_len(in.a[i]));
+	memcpy(got_x, pong_len, sizeof(got_x));
+	report_length("pong.h", "len", mops);
+
+	TIMED(mops, pong_out[i] = vec2_rotate(in.a[i], in.degrees[i]));
+	collect_vec2(pong_out);
+	report_rotation("pong.h", "rotate", mops);
+}
+
+/*
+ * one floating point backend: T is the scalar, SUFFIX picks the libm
+ * variant (l, nothing, f) and CORDIC_STEPS is about the mantissa width.
+ * results are stored as T so the timing doesn't include widening them.
+ */
+#define FLOAT_BACKEND(name, T, SUFFIX, CORDIC_STEPS) \
+	static T name##_x[INPUTS], name##_y[INPUTS], name##_bx[INPUTS], name##_by[INPUTS], name##_deg[INPUTS]; \
+	static T name##_ox[INPUTS], name##_oy[INPUTS]; \
+	static T name##_sin[LUT_SIZE]; \
+	static T name##_atan[CORDIC_STEPS]; \
+	static T name##_gain; \
+	\
+	static void name##_init(void) { \
+		for (int i = 0; i < INPUTS; i++) { \
+			name##_x[i] = in.a[i].x, name##_y[i] = in.a[i].y; \
+			name##_bx[i] = in.b[i].x, name##_by[i] = in.b[i].y; \
+			name##_deg[i] = in.degrees[i]; \
+		} \
+		for (int i = 0; i < LUT_SIZE; i++) \
+			name##_sin[i] = sinl(2 * M_PI * i / LUT_SIZE); \
+		\
+		f64 gain = 1; \
+		for (int i = 0; i < CORDIC_STEPS; i++) { \
+			name##_atan[i] = atanl(ldexpl(1, -i)) * 180 / M_PI; \
+			gain /= sqrtl(1 + ldexpl(1, -2 * i)); \
+		} \
+		name##_gain = gain; \
+	} \
+	\
+	static void name##_collect(void) { \
+		for (int i = 0; i < INPUTS; i++) \
+			got_x[i] = name##_ox[i], got_y[i] = name##_oy[i]; \
+	} \
+	\
+	static inline void name##_rotate_libm(const T x, const T y, const T deg, T *ox, T *oy) { \
+		const T rad = deg * (T)(M_PI / 180); \
+		const T c = cos##SUFFIX(rad), s = sin##SUFFIX(rad); \
+		*ox = c * x - s * y; \
+		*oy = s * x + c * y; \
+	} \
+	\
+	static inline void name##_rotate_lut(const T x, const T y, const T deg, T *ox, T *oy) { \
+		const int i = (int)(deg * (T)(LUT_SIZE / 360.0) + (T)0.5) & LUT_MASK; \
+		const T s = name##_sin[i], c = name##_sin[(i + LUT_SIZE / 4) & LUT_MASK]; \
+		*ox = c * x - s * y; \
+		*oy = s * x + c * y; \
+	} \
+	\
+	static inline void name##_rotate_cordic(T x, T y, T deg, T *ox, T *oy) { \
+		if (deg > 180) \
+			deg -= 360; \
+		if (deg > 90) \
+			deg -= 180, x = -x, y = -y; \
+		else if (deg < -90) \
+			deg += 180, x = -x, y = -y; \
+		\
+		T scale = 1; \
+		for (int i = 0; i < CORDIC_STEPS; i++, scale /= 2) { \
+			const T nx = deg >= 0 ? x - y * scale : x + y * scale; \
+			const T ny = deg >= 0 ? y + x * scale : y - x * scale; \
+			deg -= deg >= 0 ? name##_atan[i] : -name##_atan[i]; \
+			x = nx, y = ny; \
+		} \
+		*ox = x * name##_gain; \
+		*oy = y * name##_gain; \
+	} \
+	\
+	static void name##_bench(void) { \
+		name##_init(); \
+		double mops; \
+		\
+		TIMED(mops, name##_ox[i] = name##_x[i] + name##_bx[i]; name##_oy[i] = name##_y[i] + name##_by[i]); \
+		name##_collect(); \
+		report_vector(#name, "add", mops, in.add); \
+		\
+		TIMED(mops, name##_ox[i] = name##_x[i] - name##_bx[i]; name##_oy[i] = name##_y[i] - name##_by[i]); \
+		name##_collect(); \
+		report_vector(#name, "sub", mops, in.sub); \
+		\
+		TIMED(mops, name##_ox[i] = -name##_x[i]; name##_oy[i] = -name##_y[i]); \
+		name##_collect(); \
+		report_vector(#name, "negate", mops, in.negate); \
+		\
+		TIMED(mops, name##_ox[i] = sqrt##SUFFIX(name##_x[i] * name##_x[i] + name##_y[i] * name##_y[i])); \
+		name##_collect(); \
+		report_length(#name, "len sqrt", mops); \
+		\
+		TIMED(mops, name##_rotate_libm(name##_x[i], name##_y[i], name##_deg[i], &name##_ox[i], &name##_oy[i])); \
+		name##_collect(); \
+		report_rotation(#name, "rotate libm", mops); \
+		TIMED(mops, name##_rotate_lut(name##_x[i], name##_y[i], name##_deg[i], &name##_ox[i], &name##_oy[i])); \
+		name##_collect(); \
+		report_rotation(#name, "rotate lut", mops); \
+		TIMED(mops, name##_rotate_cordic(name##_x[i], name##_y[i], name##_deg[i], &name##_ox[i], &name##_oy[i])); \
+		name##_collect(); \
+		report_rotation(#name, "rotate cordic", mops); \
+	}
+
+FLOAT_BACKEND(long_double, long double, l, 64)
+FLOAT_BACKEND(double, double, , 53)
+FLOAT_BACKEND(float, float, f, 24)
+
+
+/*
+ * 16.16 fixed point. angles are degrees in 16.16 too, the sine table and
+ * cordic's angles are in 2.30 so rotations keep their precision until the
+ * final shift.
+ */
+typedef int32_t fix_t;
+
+#define FIX_CORDIC_STEPS	30
+
+static fix_t fix_x[INPUTS], fix_y[INPUTS], fix_bx[INPUTS], fix_by[INPUTS], fix_deg[INPUTS];
+static int64_t fix_ox[INPUTS], fix_oy[INPUTS];
+static int32_t fix_sin[LUT_SIZE];
+static int64_t fix_atan[FIX_CORDIC_STEPS];
+static int64_t fix_gain;
+
+static inline fix_t fix_from(const f64 v) {
+	return llroundl(v * FIX_ONE);
+}
+
+static inline f64 fix_to(const int64_t v) {
+	return (f64)v / FIX_ONE;
+}
+
+static void fix_init(void) {
+	for (int i = 0; i < INPUTS; i++) {
+		fix_x[i] = fix_from(in.a[i].x), fix_y[i] = fix_from(in.a[i].y);
+		fix_bx[i] = fix_from(in.b[i].x), fix_by[i] = fix_from(in.b[i].y);
+		fix_deg[i] = fix_from(in.degrees[i]);
+	}
+
+	for (int i = 0; i < LUT_SIZE; i++)
+		fix_sin[i] = llroundl(sinl(2 * M_PI * i / LUT_SIZE) * (1 << ANGLE_SHIFT));
+
+	f64 gain = 1;
+	for (int i = 0; i < FIX_CORDIC_STEPS; i++) {
+		fix_atan[i] = llroundl(atanl(ldexpl(1, -i)) * 180 / M_PI * FIX_ONE);
+		gain /= sqrtl(1 + ldexpl(1, -2 * i));
+	}
+	fix_gain = llroundl(gain * (1 << ANGLE_SHIFT));
+}
+
+/* floor(sqrt(v)), one bit at a time */
+static inline uint64_t isqrt(uint64_t v) {
+	uint64_t root = 0;
+
+	for (uint64_t bit = 1ULL << 62; bit; bit >>= 2) {
+		if (v >= root + bit) {
+			v -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+	}
+
+	return root;
+}
+
+static inline int64_t fix_len(const fix_t x, const fix_t y) {
+	return isqrt((uint64_t)((int64_t)x * x + (int64_t)y * y));
+}
+
+static void fix_collect(void) {
+	for (int i = 0; i < INPUTS; i++)
+		got_x[i] = fix_to(fix_ox[i]), got_y[i] = fix_to(fix_oy[i]);
+}
+
+static inline void fix_rotate_libm(const fix_t x, const fix_t y, const fix_t deg, int64_t *ox, int64_t *oy) {
+	const double rad = deg * (M_PI / 180 / FIX_ONE);
+	const int64_t c = llround(cos(rad) * (1 << ANGLE_SHIFT)), s = llround(sin(rad) * (1 << ANGLE_SHIFT));
+	*ox = (c * x - s * y) >> ANGLE_SHIFT;
+	*oy = (s * x + c * y) >> ANGLE_SHIFT;
+}
+
+static inline void fix_rotate_lut(const fix_t x, const fix_t y, const fix_t deg, int64_t *ox, int64_t *oy) {
+	const int i = (int)(((int64_t)deg * LUT_SIZE / 360 + FIX_ONE / 2) >> FIX_SHIFT) & LUT_MASK;
+	const int64_t s = fix_sin[i], c = fix_sin[(i + LUT_SIZE / 4) & LUT_MASK];
+	*ox = (c * x - s * y) >> ANGLE_SHIFT;
+	*oy = (s * x + c * y) >> ANGLE_SHIFT;
+}
+
+static inline void fix_rotate_cordic(int64_t x, int64_t y, int64_t deg, int64_t *ox, int64_t *oy) {
+	if (deg > 180 * FIX_ONE)
+		deg -= 360 * FIX_ONE;
+	if (deg > 90 * FIX_ONE)
+		deg -= 180 * FIX_ONE, x = -x, y = -y;
+	else if (deg < -90 * FIX_ONE)
+		deg += 180 * FIX_ONE, x = -x, y = -y;
+
+	/* extra fraction bits so the shifts don't throw away the low bits too early */
+	x <<= 14, y <<= 14;
+
+	for (int i = 0; i < FIX_CORDIC_STEPS; i++) {
+		const int64_t nx = deg >= 0 ? x - (y >> i) : x + (y >> i);
+		const int64_t ny = deg >= 0 ? y + (x >> i) : y - (x >> i);
+		deg -= deg >= 0 ? fix_atan[i] : -fix_atan[i];
+		x = nx, y = ny;
+	}
+
+	*ox = ((x >> 14) * fix_gain) >> ANGLE_SHIFT;
+	*oy = ((y >> 14) * fix_gain) >> ANGLE_SHIFT;
+}
+
+static void fix_bench(void) {
+	const char *backend = "fixed 16.16";
+	fix_init();
+	double mops;
+
+	TIMED(mops, fix_ox[i] = fix_x[i] + fix_bx[i]; fix_oy[i] = fix_y[i] + fix_by[i]);
+	fix_collect();
+	report_vector(backend, "add", mops, in.add);
+
+	TIMED(mops, fix_ox[i] = fix_x[i] - fix_bx[i]; fix_oy[i] = fix_y[i] - fix_by[i]);
+	fix_collect();
+	report_vector(backend, "sub", mops, in.sub);
+
+	TIMED(mops, fix_ox[i] = -fix_x[i]; fix_oy[i] = -fix_y[i]);
+	fix_collect();
+	report_vector(backend, "negate", mops, in.negate);
+
+	TIMED(mops, fix_ox[i] = fix_len(fix_x[i], fix_y[i]));
+	fix_collect();
+	report_length(backend, "len isqrt", mops);
+
+	TIMED(mops, fix_rotate_libm(fix_x[i], fix_y[i], fix_deg[i], &fix_ox[i], &fix_oy[i]));
+	fix_collect();
+	report_rotation(backend, "rotate libm", mops);
+	TIMED(mops, fix_rotate_lut(fix_x[i], fix_y[i], fix_deg[i], &fix_ox[i], &fix_oy[i]));
+	fix_collect();
+	report_rotation(backend, "rotate lut", mops);
+	TIMED(mops, fix_rotate_cordic(fix_x[i], fix_y[i], fix_deg[i], &fix_ox[i], &fix_oy[i]));
+	fix_collect();
+	report_rotation(backend, "rotate cordic", mops);
+}
+
+
+int main(int argc, char **argv) {
+	for (int opt; (opt = getopt(argc, argv, "n:")) != -1;) {
+		switch (opt) {
+		case 'n': reps = atoi(optarg); break;
+		default: die("usage: %s [-n passes]", argv[0]);
+		}
+	}
+
+	assert_ok(reps < 1, "need at least one pass");
+
+	inputs_init();
+
+	printf("%d inputs in [-%.0Lf, %.0Lf] x %d passes, error against pong.h's long double vec2\n",
+			INPUTS, INPUT_RANGE, INPUT_RANGE, reps);
+	printf("  %-12s %-16s %10s %12s %8s\n", "backend", "op", "Mops/s", "max error", "rounded");
+
+	pong_bench();
+	long_double_bench();
+	double_bench();
+	float_bench();
+	fix_bench();
+}
+
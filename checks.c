@@ -0,0 +1,524 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pong.h"
+#include "pong_tools.h"
+
+/*
+ * regression checks for the engine, each a function that returns whether
+ * it held. `make check` runs them all and fails if any didn't.
+ */
+typedef struct {
+	const char *name;
+	bool (*run)(void);
+} check_t;
+
+/* a removed entity's handle stops resolving, even once its slot is reused */
+static bool check_pool_handles(void) {
+	pong_ctx_t *ctx = pong_new(80, 24, 1);
+	const entity_t e = *pong_get_entity(ctx, ctx->ball);
+
+	const entity_handle_t a = pong_add_entity(ctx, e);
+	const entity_handle_t b = pong_add_entity(ctx, e);
+	pong_remove_entity(ctx, a);
+	bool ok = !pong_get_entity(ctx, a) && pong_get_entity(ctx, b);
+
+	const entity_handle_t c = pong_add_entity(ctx, e);
+	ok = ok && c.index == a.index && !pong_get_entity(ctx, a) && pong_get_entity(ctx, c);
+
+	/* bulk despawn takes the newest first, which leaves just the ball */
+	ok = ok && pong_despawn(ctx, 2) == 2 && ctx->pool.count == 1;
+	ok = ok && !pong_get_entity(ctx, b) && !pong_get_entity(ctx, c) && pong_get_entity(ctx, ctx->ball);
+
+	pong_free(ctx);
+	return ok;
+}
+
+/* a full pool turns the next entity away instead of exiting */
+static bool check_pool_full(void) {
+	pong_ctx_t *ctx = pong_new(80, 24, 1);
+	const entity_t e = *pong_get_entity(ctx, ctx->ball);
+
+	bool ok = pong_spawn(ctx, MAX_ENTITIES) == MAX_ENTITIES - 1;
+
+	errno = 0;
+	const entity_handle_t h = pong_add_entity(ctx, e);
+	ok = ok && errno == ENOSPC && !pong_get_entity(ctx, h) && ctx->pool.count == MAX_ENTITIES;
+
+	pong_despawn(ctx, 1);
+	ok = ok && pong_get_entity(ctx, pong_add_entity(ctx, e));
+
+	pong_free(ctx);
+	return ok;
+}
+
+/* the row kernels against the scalar blend_u8 and add_u8, over every alpha and every tail length */
+static bool check_row_kernels(void) {
+	enum { CELLS = 40 };
+	rgb dst[CELLS], src[CELLS], want[CELLS];
+	uint64_t state = 1;
+
+	for (int alpha = 0; alpha <= 0xFF; alpha++) {
+		for (int n = 0; n <= CELLS; n++) {
+			uint8_t *d = (uint8_t *)dst, *s = (uint8_t *)src, *w = (uint8_t *)want;
+			for (size_t i = 0; i < sizeof(dst); i++) {
+				state = state * 6364136223846793005 + 1442695040888963407;
+				d[i] = state >> 56, s[i] = state >> 48;
+			}
+
+			for (int i = 0; i < n * 3; i++)
+				w[i] = blend_u8(d[i], s[i], alpha);
+			memcpy(w + n * 3, d + n * 3, sizeof(dst) - n * 3);
+
+			rgb_blend_row(dst, src, n, alpha);
+			if (memcmp(dst, want, sizeof(dst)))
+				return false;
+
+			for (int i = 0; i < n * 3; i++)
+				w[i] = add_u8(d[i], s[i]);
+
+			rgb_add_row(dst, src, n);
+			if (memcmp(dst, want, sizeof(dst)))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/* a ball going straight up breaks the first brick it meets, just that one, and bounces */
+static bool check_brick_break(void) {
+	pong_ctx_t *ctx = pong_new(40, 16, 1);
+	pong_set_breakout(ctx, true);
+
+	entity_t e = *pong_get_entity(ctx, ctx->ball);
+	e.pos = (vec2){ 2, 8 };
+	e.delta = (vec2){ 0, -1 };
+	e.size = (vec2){ 1, 1 };
+	e.shape = SHAPE_RECT;
+	pong_remove_entity(ctx, ctx->ball);
+	ctx->ball = pong_add_entity(ctx, e);
+
+	const brick_field_t *f = &ctx->bricks;
+	const uint32_t bricks = f->count;
+	for (int i = 0; i < 8 && f->count == bricks; i++)
+		pong_tick(ctx);
+
+	/* the lowest row of bricks is at y = 4, its first brick covers x = 1..4 */
+	const uint64_t row = f->bits[(size_t)(4 - 1) * f->words];
+	const entity_t *b = pong_get_entity(ctx, ctx->ball);
+	const bool ok = f->count == bricks - 1 && (row & 0x1F) == 0 && (row >> 5 & 0xF) == 0xF
+		&& b->delta.y > 0 && b->pos.y > 4;
+
+	pong_free(ctx);
+	return ok;
+}
+
+/*
+ * plays monochrome output onto a screen of reverse video flags: cursor
+ * moves, reverse on and off, and spaces. false on anything else.
+ */
+static bool mono_play(uint8_t *screen, const int width, const char *p, const char *end) {
+	int x = 1, y = 1, reverse = 0;
+
+	while (p < end) {
+		if (*p == ' ') {
+			screen[y * width + x++] = reverse;
+			p++;
+		} else if (end - p >= 4 && !memcmp(p, "\033[7m", 4)) {
+			reverse = 1, p += 4;
+		} else if (end - p >= 4 && !memcmp(p, "\033[0m", 4)) {
+			reverse = 0, p += 4;
+		} else if (end - p >= 5 && !memcmp(p, "\033[27m", 5)) {
+			reverse = 0, p += 5;
+		} else if (end - p >= 2 && p[0] == '\033' && p[1] == '[') {
+			char *next;
+			y = strtol(p + 2, &next, 10);
+			if (*next != ';')
+				return false;
+			x = strtol(next + 1, &next, 10);
+			if (*next != 'H')
+				return false;
+			p = next + 1;
+		} else {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* frame after frame, what the diffs leave on screen is exactly the bitplane */
+static bool check_monochrome_diff(void) {
+	enum { WIDTH = 70, HEIGHT = 20 };
+	static uint8_t screen[WIDTH * HEIGHT];
+	static char frame[1 << 16];
+
+	pong_ctx_t *ctx = pong_new(WIDTH, HEIGHT, 5);
+	pong_set_breakout(ctx, true);
+	pong_set_scoreboard(ctx, true);
+	pong_set_monochrome(ctx, true);
+	pong_spawn(ctx, 12);
+	memset(screen, 2, sizeof(screen));
+
+	const bitplane_t *bp = &ctx->monochrome;
+	bool ok = true;
+	for (int tick = 0; ok && tick < 200; tick++) {
+		size_t n;
+		while (ok && (n = pong_render(ctx, frame, sizeof(frame))))
+			ok = mono_play(screen, WIDTH, frame, frame + n);
+
+		for (int y = 1; ok && y < HEIGHT - 1; y++) {
+			const uint64_t *row = bp->bits + (size_t)(y - 1) * bp->words;
+			for (int x = 1; ok && x < WIDTH - 1; x++)
+				ok = screen[y * WIDTH + x] == ((row[(x - 1) >> 6] >> ((x - 1) & 63)) & 1);
+		}
+
+		pong_tick(ctx);
+	}
+
+	/* and once it's all out, an unchanged frame sends nothing */
+	while (pong_render(ctx, frame, sizeof(frame)))
+		;
+	ok = ok && !pong_render(ctx, frame, sizeof(frame));
+
+	pong_free(ctx);
+	return ok;
+}
+
+/* after shrinking the field every entity fits under the size cap and sits inside the walls */
+static bool check_resize_clamp(void) {
+	enum { WIDTH = 30, HEIGHT = 10 };
+	static char frame[1 << 16];
+
+	pong_ctx_t *ctx = pong_new(160, 50, 7);
+	pong_spawn(ctx, 300);
+	for (int i = 0; i < 12; i++)
+		pong_grow(ctx);
+	for (int i = 0; i < 25; i++)
+		pong_tick(ctx);
+
+	pong_resize(ctx, WIDTH, HEIGHT);
+
+	bool ok = true;
+	for (uint32_t i = 0; ok && i < ctx->pool.count; i++) {
+		const entity_t *e = &ctx->pool.entities[i];
+		ok = e->size.x <= (WIDTH - 1) / 2 && e->size.y <= (HEIGHT - 1) / 2
+			&& e->pos.x >= 1 && e->pos.x + e->size.x < WIDTH - 1
+			&& e->pos.y >= 1 && e->pos.y + e->size.y < HEIGHT - 1
+			&& e->spans->width <= WIDTH && e->spans->height <= HEIGHT;
+	}
+
+	/* and the next ticks draw into the smaller field without going past it */
+	for (int i = 0; ok && i < 10; i++) {
+		pong_tick(ctx);
+		while (pong_render(ctx, frame, sizeof(frame)))
+			;
+	}
+
+	pong_free(ctx);
+	return ok;
+}
+
+/* bricks broken before a burst of resizes stay broken through it */
+static bool check_resize_bricks(void) {
+	pong_ctx_t *ctx = pong_new(80, 30, 2);
+	pong_set_breakout(ctx, true);
+	pong_spawn(ctx, 40);
+
+	const uint32_t full = ctx->bricks.count;
+	for (int i = 0; i < 200 && ctx->bricks.count > full - 10; i++)
+		pong_tick(ctx);
+
+	const uint32_t left = ctx->bricks.count;
+	const size_t bytes = (size_t)ctx->bricks.words * ctx->bricks.height * sizeof(uint64_t);
+	uint64_t *bits = malloc(bytes);
+	memcpy(bits, ctx->bricks.bits, bytes);
+
+	/* the same size again changes nothing */
+	pong_resize(ctx, 80, 30);
+	bool ok = left < full && ctx->bricks.count == left && !memcmp(bits, ctx->bricks.bits, bytes);
+
+	/*
+	 * shrinking keeps what was broken inside the smaller field, and growing
+	 * back only brings new bricks where the smaller field didn't reach
+	 */
+	pong_resize(ctx, 50, 21);
+	ok = ok && ctx->bricks.count < left;
+	pong_resize(ctx, 80, 30);
+
+	/* the smaller field has the brick rows 2, 4 and 6, in cells 1 to 48 */
+	const brick_field_t *f = &ctx->bricks;
+	for (int y = 2; ok && y <= 6; y += 2) {
+		const uint64_t *row = f->bits + (size_t)(y - 1) * f->words;
+		const uint64_t *was = bits + (size_t)(y - 1) * f->words;
+		ok = !(row[0] & ~was[0] & ((1ULL << 48) - 1));
+	}
+
+	free(bits);
+	pong_free(ctx);
+	return ok;
+}
+
+/* a crowd whose keyframe and deltas outgrow the ring, then every tick in it sought back to */
+static bool check_rewind_overflow(void) {
+	pong_ctx_t *ctx = pong_new(200, 60, 1);
+	pong_set_rewind(ctx, true);
+	pong_spawn(ctx, 115000);
+
+	for (int i = 0; i < 80; i++)
+		pong_tick(ctx);
+
+	const rewind_t *r = &ctx->rewind;
+	bool ok = r->head != r->tail && r->entries[r->tail % REWIND_ENTRIES].keyframe;
+
+	while (ok && pong_rewind(ctx))
+		;
+	ok = ok && r->head - r->tail == 1;
+
+	pong_free(ctx);
+	return ok;
+}
+
+/* nan and inf never parse, and a spawn count past the pool fills it */
+static bool check_command_values(void) {
+	static const char *const rejected[] = {
+		"fps nan", "fps inf", "size nan nan", "size 4 inf", "delta -inf 1", "spawn nan",
+	};
+
+	pong_command_t cmd;
+	for (size_t i = 0; i < sizeof(rejected) / sizeof(rejected[0]); i++) {
+		if (pong_command_parse(rejected[i], &cmd))
+			return false;
+	}
+
+	pong_ctx_t *ctx = pong_new(80, 24, 1);
+	const bool parsed = pong_command_parse("spawn 1e30", &cmd);
+	if (parsed)
+		pong_command(ctx, &cmd);
+
+	const bool ok = parsed && ctx->pool.count == MAX_ENTITIES;
+	pong_free(ctx);
+	return ok;
+}
+
+static bool write_file(const char *path, const void *data, const size_t len) {
+	FILE *f = fopen(path, "wb");
+	if (!f)
+		return false;
+
+	const bool ok = fwrite(data, 1, len, f) == len;
+	return !fclose(f) && ok;
+}
+
+static void *read_file(const char *path, size_t *len) {
+	FILE *f = fopen(path, "rb");
+	assert_ok(!f, "couldn't open %s", path);
+
+	fseek(f, 0, SEEK_END);
+	*len = ftell(f);
+	rewind(f);
+
+	void *data = malloc(*len);
+	assert_ok(!data || fread(data, 1, *len, f) != *len, "couldn't read %s", path);
+	fclose(f);
+
+	return data;
+}
+
+/* a restore of bad bytes either fails with EINVAL or gives a game that runs */
+static bool restore_survives(const char *path, const void *data, const size_t len) {
+	assert_ok(!write_file(path, data, len), "couldn't write %s", path);
+
+	static char frame[1 << 16];
+	pong_ctx_t *ctx = pong_restore(path);
+	if (!ctx)
+		return errno == EINVAL;
+
+	for (int i = 0; i < 3; i++) {
+		pong_tick(ctx);
+		while (pong_render(ctx, frame, sizeof(frame)))
+			;
+	}
+
+	pong_free(ctx);
+	return true;
+}
+
+/*
+ * truncated at every cache line, every word flipped in turn, and the ball's
+ * position set to nan, which a restore has to turn down
+ */
+static bool check_snapshot_corrupt(void) {
+	char path[] = "/tmp/pong-check-XXXXXX";
+	const int fd = mkstemp(path);
+	assert_ok(fd < 0, "couldn't create a temporary file");
+	close(fd);
+
+	pong_ctx_t *ctx = pong_new(40, 16, 3);
+	pong_set_trails(ctx, true);
+	pong_set_breakout(ctx, true);
+	pong_spawn(ctx, 4);
+	pong_despawn(ctx, 1);
+	for (int i = 0; i < 20; i++)
+		pong_tick(ctx);
+
+	const f64 ball_x = pong_get_entity(ctx, ctx->ball)->pos.x;
+	bool ok = !pong_save(ctx, path);
+	pong_free(ctx);
+
+	size_t len;
+	uint8_t *good = ok ? read_file(path, &len) : NULL;
+	uint8_t *bad = ok ? malloc(len) : NULL;
+	ok = ok && bad;
+
+	for (size_t cut = 0; ok && cut < len; cut += 64)
+		ok = restore_survives(path, good, cut);
+
+	for (size_t i = 0; ok && i + 8 <= len; i += 8) {
+		memcpy(bad, good, len);
+		for (int b = 0; b < 8; b++)
+			bad[i + b] ^= 0xA5;
+		ok = restore_survives(path, bad, len);
+	}
+
+	if (ok) {
+		memcpy(bad, good, len);
+		/* x87 long doubles only carry 10 bytes, the rest is whatever was there */
+		const size_t value_bytes = LDBL_MANT_DIG == 64 ? 10 : sizeof(f64);
+		uint8_t *x = memmem(bad, len, &ball_x, value_bytes);
+		const f64 nan = NAN;
+
+		ok = x && (memcpy(x, &nan, value_bytes), write_file(path, bad, len))
+			&& !pong_restore(path) && errno == EINVAL;
+	}
+
+	free(good);
+	free(bad);
+	unlink(path);
+	return ok;
+}
+
+/* the same entities saved from memory with different padding make the same file */
+static bool snapshot_of_padding(const int fill, const char *path, void **data, size_t *len) {
+	pong_ctx_t *ctx = pong_new(40, 16, 3);
+	const entity_t *ball = pong_get_entity(ctx, ctx->ball);
+
+	entity_t e;
+	memset(&e, fill, sizeof(e));
+	e.pos.x = 3, e.pos.y = 4;
+	e.delta.x = ball->delta.x, e.delta.y = ball->delta.y;
+	e.size.x = ball->size.x, e.size.y = ball->size.y;
+	e.shape = ball->shape;
+	e.spans = NULL;
+	e.hits = 0;
+	pong_add_entity(ctx, e);
+
+	const bool ok = !pong_save(ctx, path);
+	pong_free(ctx);
+
+	*data = ok ? read_file(path, len) : NULL;
+	return ok;
+}
+
+static bool check_snapshot_bytes(void) {
+	char path[] = "/tmp/pong-check-XXXXXX";
+	const int fd = mkstemp(path);
+	assert_ok(fd < 0, "couldn't create a temporary file");
+	close(fd);
+
+	void *zeroed = NULL, *filled = NULL;
+	size_t zeroed_len = 0, filled_len = 0;
+	bool ok = snapshot_of_padding(0x00, path, &zeroed, &zeroed_len)
+		&& snapshot_of_padding(0xFF, path, &filled, &filled_len)
+		&& zeroed_len == filled_len && !memcmp(zeroed, filled, zeroed_len);
+
+	/* and a save that can't happen says why instead of leaving anything behind */
+	pong_ctx_t *ctx = pong_new(40, 16, 3);
+	ok = ok && pong_save(ctx, "/nonexistent/pong.snap") && errno == ENOENT;
+	pong_free(ctx);
+
+	free(zeroed);
+	free(filled);
+	unlink(path);
+	return ok;
+}
+
+/* a discarded frame takes its counts and timings back with it */
+static bool check_speculate_counters(void) {
+	pong_ctx_t *ctx = pong_new(80, 24, 1);
+	pong_spawn(ctx, 8);
+
+	pong_counters_t before, after;
+	pong_counters_read(&before);
+	pong_speculate(ctx);
+	pong_speculate_discard(ctx);
+	pong_counters_read(&after);
+
+	bool ok = true;
+	for (int c = 0; c < PONG_COUNTER_COUNT; c++)
+		ok = ok && after.value[c] == before.value[c];
+	for (int t = 0; t < PONG_TIMER_COUNT; t++)
+		ok = ok && after.timer_calls[t] == before.timer_calls[t] && after.timer_ns[t] == before.timer_ns[t];
+
+	pong_free(ctx);
+	return ok;
+}
+
+static void *count_once(void *shared) {
+	pong_count(PONG_COUNTER_EVENTS, 1);
+	*(bool *)shared = pong_counters_self()->shared;
+	return NULL;
+}
+
+/* threads that come and go one after another never run out of shards, and nothing they counted is lost */
+static bool check_counter_shards(void) {
+	pong_counters_t before, after;
+	pong_counters_read(&before);
+
+	bool ok = true;
+	for (int i = 0; ok && i < 4 * PONG_COUNTER_SHARDS; i++) {
+		pthread_t t;
+		bool shared = true;
+		ok = !pthread_create(&t, NULL, count_once, &shared) && !pthread_join(t, NULL) && !shared;
+	}
+
+	pong_counters_read(&after);
+	return ok && after.value[PONG_COUNTER_EVENTS] - before.value[PONG_COUNTER_EVENTS] == 4 * PONG_COUNTER_SHARDS;
+}
+
+static const check_t checks[] = {
+	{ "stale pool handles", check_pool_handles },
+	{ "full pool", check_pool_full },
+	{ "row kernels", check_row_kernels },
+	{ "brick hit and break", check_brick_break },
+	{ "monochrome diffs", check_monochrome_diff },
+	{ "entities after a resize", check_resize_clamp },
+	{ "bricks after a resize", check_resize_bricks },
+	{ "rewind past the ring", check_rewind_overflow },
+	{ "command values", check_command_values },
+	{ "corrupt snapshots", check_snapshot_corrupt },
+	{ "snapshot bytes", check_snapshot_bytes },
+	{ "discarded frame counters", check_speculate_counters },
+	{ "counter shards", check_counter_shards },
+};
+
+int main(void) {
+	int failed = 0;
+
+	for (size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+		const bool ok = checks[i].run();
+		printf("%-32s %s\n", checks[i].name, ok ? "ok" : "FAILED");
+		failed += !ok;
+	}
+
+	return failed > 0;
+}
@@ -0,0 +1,302 @@
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+
+#include "pong.h"
+#include "pong_tools.h"
+
+/*
+ * runs the real pong binary on a pty, types at it and reads the screen
+ * back. a probe is a key that changes the mode shown on the info line
+ * ('r' shows "(resize)", 'n' "(normal)"), its latency is from writing the
+ * key to reading the new mode. resize probes set the pty size with
+ * TIOCSWINSZ and wait for the new "display: W x H". frames are counted by
+ * the clear-line that starts every info line. in storm mode every probe
+ * is a burst of resizes to random sizes, timed from the last one to the
+ * info line showing where it settled.
+ */
+#define WARMUP_NS		500000000ULL
+#define MAX_PROBES		4096
+#define MARKER_MAX		64
+
+typedef struct {
+	int master;
+	pid_t pid;
+
+	uint64_t bytes;
+	uint64_t frames;
+
+	char tail[MARKER_MAX];
+	size_t tail_len;
+} session_t;
+
+typedef struct {
+	const char *name;
+	uint64_t ns[MAX_PROBES];
+	int count;
+	int timeouts;
+} latencies_t;
+
+static void session_resize(const session_t *s, const int width, const int height) {
+	const struct winsize ws = { .ws_row = height, .ws_col = width };
+	assert_ok(ioctl(s->master, TIOCSWINSZ, &ws), "couldn't set pty size");
+}
+
+static void session_start(session_t *s, char **argv, const int width, const int height) {
+	s->master = posix_openpt(O_RDWR | O_NOCTTY);
+	assert_ok(s->master < 0 || grantpt(s->master) || unlockpt(s->master), "couldn't open a pty");
+	session_resize(s, width, height);
+
+	const char *slave = ptsname(s->master);
+	assert_ok(!slave, "couldn't name the pty slave");
+
+	s->pid = fork();
+	assert_ok(s->pid < 0, "couldn't fork");
+
+	if (!s->pid) {
+		setsid();
+
+		const int fd = open(slave, O_RDWR);
+		if (fd < 0 || ioctl(fd, TIOCSCTTY, 0))
+			_exit(127);
+
+		dup2(fd, STDIN_FILENO);
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		close(fd);
+		close(s->master);
+
+		execv(argv[0], argv);
+		_exit(127);
+	}
+}
+
+/* matches of pattern in buf that end past the first `old` bytes */
+static size_t count_new(const char *buf, const size_t len, const size_t old, const char *pattern) {
+	const size_t plen = strlen(pattern);
+	const size_t from = old >= plen ? old - plen + 1 : 0;
+	size_t n = 0;
+
+	for (const char *p = buf + from; (p = memmem(p, buf + len - p, pattern, plen)); p += plen)
+		n++;
+
+	return n;
+}
+
+/*
+ * reads whatever is there within timeout_ms and reports whether marker
+ * turned up in it. the last few bytes are kept so markers split across
+ * reads are still found.
+ */
+static bool session_read(session_t *s, const int timeout_ms, const char *marker) {
+	char buf[MARKER_MAX + (1 << 16)];
+	bool found = false;
+
+	struct pollfd pfd = { s->master, POLLIN, 0 };
+	if (poll(&pfd, 1, timeout_ms) <= 0)
+		return false;
+
+	memcpy(buf, s->tail, s->tail_len);
+	const ssize_t n = read(s->master, buf + s->tail_len, sizeof(buf) - s->tail_len);
+	if (n <= 0)
+		return false;
+
+	const size_t len = s->tail_len + n;
+
+	s->bytes += n;
+	s->frames += count_new(buf, len, s->tail_len, "\033[0K");
+	if (marker)
+		found = count_new(buf, len, s->tail_len, marker) > 0;
+
+	s->tail_len = len < MARKER_MAX ? len : MARKER_MAX;
+	memcpy(s->tail, buf + len - s->tail_len, s->tail_len);
+
+	return found;
+}
+
+static void session_drain(session_t *s, const uint64_t until) {
+	while (now_ns() < until)
+		session_read(s, 10, NULL);
+}
+
+static uint64_t probe_timeout_ns = 1000000000;
+
+static void probe(session_t *s, latencies_t *l, const char *marker) {
+	const uint64_t start = now_ns();
+
+	while (!session_read(s, 10, marker)) {
+		if (now_ns() - start > probe_timeout_ns) {
+			l->timeouts++;
+			return;
+		}
+	}
+
+	if (l->count < MAX_PROBES)
+		l->ns[l->count++] = now_ns() - start;
+}
+
+static void probe_key(session_t *s, latencies_t *l, const char key, const char *marker) {
+	assert_ok(write(s->master, &key, 1) != 1, "couldn't write to the pty");
+	probe(s, l, marker);
+}
+
+static void probe_resize(session_t *s, latencies_t *l, const int width, const int height) {
+	char marker[MARKER_MAX];
+	snprintf(marker, sizeof(marker), "display: %d x %d", width - 1, height - 1);
+
+	session_resize(s, width, height);
+	probe(s, l, marker);
+}
+
+static uint64_t storm_state = 0x2545F4914F6CDD1D;
+
+static inline int storm_draw(const int lo, const int hi) {
+	storm_state ^= storm_state << 13;
+	storm_state ^= storm_state >> 7;
+	storm_state ^= storm_state << 17;
+	return lo + storm_state % (hi - lo + 1);
+}
+
+/* fires count resizes as fast as the pty takes them, reading as it goes so pong never blocks */
+static void storm(session_t *s, latencies_t *l, const int count, const int width, const int height) {
+	int w = width, h = height;
+
+	for (int i = 0; i < count; i++) {
+		w = storm_draw(width / 2, width * 2), h = storm_draw(height / 2, height * 2);
+		session_resize(s, w, h);
+		session_read(s, 0, NULL);
+	}
+
+	char marker[MARKER_MAX];
+	snprintf(marker, sizeof(marker), "display: %d x %d", w - 1, h - 1);
+	probe(s, l, marker);
+}
+
+static void report(latencies_t *l) {
+	if (!l->count) {
+		printf("  %-8s no samples, %d timed out\n", l->name, l->timeouts);
+		return;
+	}
+
+	qsort(l->ns, l->count, sizeof(uint64_t), compare_u64);
+	printf("  %-8s %4d probes, latency us: min %.0f p50 %.0f p99 %.0f max %.0f, %d timed out\n",
+			l->name, l->count,
+			l->ns[0] / 1e3, l->ns[l->count / 2] / 1e3,
+			l->ns[l->count * 99 / 100] / 1e3, l->ns[l->count - 1] / 1e3,
+			l->timeouts);
+}
+
+static void usage(const char *prog) {
+	die("usage: %s [-d seconds] [-i probe-ms] [-w resize-every] [-s WxH] [-t timeout-ms] [-f fps] [-S resizes/s] ./pong [args]", prog);
+}
+
+int main(int argc, char **argv) {
+	double duration = 5;
+	int interval_ms = 100;
+	int resize_every = 10;
+	int width = 120, height = 40;
+	double fps = PONG_DEFAULT_FPS;
+	int storm_rate = 0;
+
+	for (int opt; (opt = getopt(argc, argv, "+d:i:w:s:t:f:S:")) != -1;) {
+		switch (opt) {
+		case 'd': duration = atof(optarg); break;
+		case 'i': interval_ms = atoi(optarg); break;
+		case 'w': resize_every = atoi(optarg); break;
+		case 's':
+			if (sscanf(optarg, "%dx%d", &width, &height) != 2)
+				usage(argv[0]);
+			break;
+		case 't': probe_timeout_ns = atof(optarg) * 1e6; break;
+		case 'f': fps = atof(optarg); break;
+		case 'S': storm_rate = atoi(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+
+	if (optind == argc || duration <= 0 || interval_ms < 1 || !probe_timeout_ns || fps <= 0 || storm_rate < 0 || width < 3 || height < 3)
+		usage(argv[0]);
+
+	signal(SIGPIPE, SIG_IGN);
+
+	session_t s = { 0 };
+	session_start(&s, argv + optind, width, height);
+
+	static latencies_t keys = { .name = "keys" }, resizes = { .name = "resizes" }, storms = { .name = "storms" };
+	uint64_t stormed = 0;
+
+	session_drain(&s, now_ns() + WARMUP_NS);
+
+	const uint64_t start = now_ns(), bytes = s.bytes, frames = s.frames;
+	const uint64_t end = start + duration * 1e9;
+
+	/* keys alternate on their own count, so each one changes what's shown */
+	for (int i = 0, k = 0; now_ns() < end; i++) {
+		const uint64_t next = now_ns() + interval_ms * 1000000ULL;
+
+		if (storm_rate > 0) {
+			const int count = storm_rate * interval_ms / 1000 > 0 ? storm_rate * interval_ms / 1000 : 1;
+			storm(&s, &storms, count, width, height);
+			stormed += count;
+		} else if (resize_every > 0 && i % resize_every == resize_every - 1) {
+			const bool grow = i / resize_every % 2 == 0;
+			probe_resize(&s, &resizes, grow ? width + 20 : width, grow ? height + 10 : height);
+		} else {
+			probe_key(&s, &keys, k % 2 ? 'n' : 'r', k % 2 ? "(normal)" : "(resize)");
+			k++;
+		}
+
+		session_drain(&s, next);
+	}
+
+	const uint64_t elapsed = now_ns() - start;
+	const uint64_t sent = s.bytes - bytes, drawn = s.frames - frames;
+
+	assert_ok(write(s.master, "q", 1) != 1, "couldn't write to the pty");
+
+	/* over a slow link the quit has to get there and the last frames back first */
+	int status = 0;
+	pid_t exited = 0;
+	for (const uint64_t quit = now_ns(); !exited && now_ns() - quit < probe_timeout_ns + 200000000;) {
+		session_read(&s, 10, NULL);
+		exited = waitpid(s.pid, &status, WNOHANG);
+	}
+
+	if (exited != s.pid) {
+		kill(s.pid, SIGTERM);
+		waitpid(s.pid, &status, 0);
+	}
+	close(s.master);
+
+	printf("%s on a %d x %d pty for %.1f s\n", argv[optind], width, height, elapsed / 1e9);
+	/* pong draws every tick, whatever doesn't arrive at the target rate was held up on the way */
+	const double delivered = drawn * 1e9 / elapsed;
+	printf("  %.0f bytes/s, %.1f frames/s, %.1f%% short of %.0f\n",
+			sent * 1e9 / elapsed, delivered,
+			delivered < fps ? 100 * (1 - delivered / fps) : 0.0, fps);
+	if (storm_rate > 0) {
+		printf("  %.0f resizes/s\n", stormed * 1e9 / elapsed);
+		report(&storms);
+	} else {
+		report(&keys);
+		report(&resizes);
+	}
+
+	if (WIFEXITED(status))
+		printf("  exited with %d\n", WEXITSTATUS(status));
+	else
+		printf("  killed by signal %d\n", WTERMSIG(status));
+
+	return !(WIFEXITED(status) && !WEXITSTATUS(status));
+}
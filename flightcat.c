@@ -0,0 +1,56 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pong_flight.h"
+
+#define die(fmt, ...) \
+	do { fprintf(stderr, fmt __VA_OPT__(,) __VA_ARGS__); fputc('\n', stderr); exit(1); } while(0)
+
+#define assert_ok(ret, fmt, ...) \
+	do { if (ret) { die(fmt __VA_OPT__(,) __VA_ARGS__); } } while(0)
+
+/* prints the ticks in a flight recorder dump, oldest first */
+int main(int argc, char **argv) {
+	if (argc < 2)
+		die("usage: %s file.flight [ticks]", argv[0]);
+
+	static pong_flight_t f;
+
+	const int fd = open(argv[1], O_RDONLY);
+	assert_ok(fd < 0, "couldn't open %s", argv[1]);
+	assert_ok(read(fd, &f, sizeof(f)) != sizeof(f), "%s is too short for a flight recorder dump", argv[1]);
+	close(fd);
+
+	const pong_flight_header_t *h = &f.header;
+	assert_ok(h->magic != PONG_FLIGHT_MAGIC || h->version != PONG_FLIGHT_VERSION
+			|| h->record_size != sizeof(pong_flight_record_t) || h->capacity != PONG_FLIGHT_TICKS,
+			"%s isn't a pong flight recorder dump (version %d)", argv[1], PONG_FLIGHT_VERSION);
+
+	const uint64_t kept = h->head < PONG_FLIGHT_TICKS ? h->head : PONG_FLIGHT_TICKS;
+	const uint64_t want = argc > 2 ? strtoull(argv[2], NULL, 10) : kept;
+	const uint64_t count = want < kept ? want : kept;
+
+	if (h->signal)
+		printf("pid %u killed by signal %d (%s)", h->pid, h->signal, strsignal(h->signal));
+	else
+		printf("pid %u exited through die()", h->pid);
+	printf(", last %lu of %lu ticks\n", (unsigned long)count, (unsigned long)h->head);
+
+	for (uint64_t i = h->head - count; i < h->head; i++) {
+		const pong_flight_record_t *r = &f.records[i % PONG_FLIGHT_TICKS];
+
+		printf("tick %lu %u x %u entities %u frame %lu ns %u bytes mode %u ball (%.3f, %.3f) %.0fx%.0f delta (%.3f, %.3f)",
+				(unsigned long)r->tick, r->width, r->height, r->entities,
+				(unsigned long)r->frame_ns, r->frame_bytes, r->mode,
+				r->ball_x, r->ball_y, r->ball_w, r->ball_h, r->ball_dx, r->ball_dy);
+
+		if (r->key)
+			printf(" key '%c'", r->key);
+		if (r->commands)
+			printf(" commands %u last op %u", r->commands, r->last_op);
+		putchar('\n');
+	}
+}
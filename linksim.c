@@ -0,0 +1,272 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+
+#include "pong.h"
+#include "pong_tools.h"
+
+/*
+ * runs a command on its own pty and relays it to ours over a simulated
+ * link: every chunk is serialised at the link's rate, then arrives after
+ * the delay plus up to the jitter, never overtaking the chunk before it.
+ * the link only holds so many bytes in flight, past that the command's
+ * writes block like they would behind a full tcp window.
+ */
+#define LINK_CAPACITY		(1 << 16)
+#define LINK_SEGMENTS		4096
+#define LINK_CHUNK_MAX		4096
+
+typedef struct {
+	uint64_t deliver;
+	uint32_t offset;
+	uint32_t len;
+} segment_t;
+
+typedef struct {
+	int in, out;
+
+	double rate;
+	uint64_t delay;
+	uint64_t jitter;
+	uint32_t capacity;
+
+	char data[LINK_CAPACITY];
+	uint32_t head, tail;
+
+	segment_t segments[LINK_SEGMENTS];
+	uint32_t seg_head, seg_tail;
+
+	uint64_t free_at;
+	uint64_t last_deliver;
+	bool closed;
+} link_t;
+
+static uint64_t jitter_state = 0x9E3779B97F4A7C15;
+
+static inline uint64_t jitter_draw(const uint64_t jitter) {
+	jitter_state ^= jitter_state << 13;
+	jitter_state ^= jitter_state >> 7;
+	jitter_state ^= jitter_state << 17;
+	return jitter ? jitter_state % (jitter + 1) : 0;
+}
+
+static inline uint32_t link_buffered(const link_t *l) {
+	return l->head - l->tail;
+}
+
+/* about 10ms of the link's rate per read, so a slow link trickles instead of bursting */
+static inline uint32_t link_chunk(const link_t *l) {
+	uint32_t chunk = l->rate > 0 ? l->rate / 100 : LINK_CHUNK_MAX;
+	chunk = chunk < 1 ? 1 : chunk > LINK_CHUNK_MAX ? LINK_CHUNK_MAX : chunk;
+
+	const uint32_t room = l->capacity - link_buffered(l);
+	return chunk < room ? chunk : room;
+}
+
+static inline bool link_can_read(const link_t *l) {
+	return !l->closed && link_chunk(l) && l->seg_head - l->seg_tail < LINK_SEGMENTS;
+}
+
+static void link_read(link_t *l) {
+	char buf[LINK_CHUNK_MAX];
+	const ssize_t n = read(l->in, buf, link_chunk(l));
+
+	if (n <= 0) {
+		if (n < 0 && (errno == EINTR || errno == EAGAIN))
+			return;
+
+		l->closed = true;
+		return;
+	}
+
+	const uint64_t now = now_ns();
+	const uint64_t start = l->free_at > now ? l->free_at : now;
+	l->free_at = start + (l->rate > 0 ? (uint64_t)(n * 1e9 / l->rate) : 0);
+
+	uint64_t deliver = l->free_at + l->delay + jitter_draw(l->jitter);
+	if (deliver < l->last_deliver)
+		deliver = l->last_deliver;
+	l->last_deliver = deliver;
+
+	segment_t *seg = &l->segments[l->seg_head++ % LINK_SEGMENTS];
+	*seg = (segment_t){ deliver, l->head, n };
+
+	for (ssize_t i = 0; i < n; i++)
+		l->data[l->head++ % LINK_CAPACITY] = buf[i];
+}
+
+static void link_deliver(link_t *l, const uint64_t now) {
+	while (l->seg_tail != l->seg_head) {
+		segment_t *seg = &l->segments[l->seg_tail % LINK_SEGMENTS];
+		if (seg->deliver > now)
+			return;
+
+		char buf[LINK_CHUNK_MAX];
+		for (uint32_t i = 0; i < seg->len; i++)
+			buf[i] = l->data[(seg->offset + i) % LINK_CAPACITY];
+
+		for (uint32_t done = 0; done < seg->len;) {
+			const ssize_t n = write(l->out, buf + done, seg->len - done);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0)
+				return;
+			done += n;
+		}
+
+		l->tail += seg->len;
+		l->seg_tail++;
+	}
+}
+
+/* ns until the next segment is due, -1 if nothing's in flight */
+static int64_t link_next(const link_t *l, const uint64_t now) {
+	if (l->seg_tail == l->seg_head)
+		return -1;
+
+	const uint64_t due = l->segments[l->seg_tail % LINK_SEGMENTS].deliver;
+	return due > now ? (int64_t)(due - now) : 0;
+}
+
+
+static volatile sig_atomic_t window_changed;
+
+static void on_winch(int sig) {
+	(void)sig;
+	window_changed = 1;
+}
+
+static pid_t spawn(char **argv, int *master) {
+	*master = posix_openpt(O_RDWR | O_NOCTTY);
+	assert_ok(*master < 0 || grantpt(*master) || unlockpt(*master), "couldn't open a pty");
+
+	struct winsize ws;
+	if (!ioctl(STDIN_FILENO, TIOCGWINSZ, &ws))
+		ioctl(*master, TIOCSWINSZ, &ws);
+
+	const char *slave = ptsname(*master);
+	assert_ok(!slave, "couldn't name the pty slave");
+
+	const pid_t pid = fork();
+	assert_ok(pid < 0, "couldn't fork");
+
+	if (!pid) {
+		setsid();
+
+		const int fd = open(slave, O_RDWR);
+		if (fd < 0 || ioctl(fd, TIOCSCTTY, 0))
+			_exit(127);
+
+		dup2(fd, STDIN_FILENO);
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		close(fd);
+		close(*master);
+
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+
+	return pid;
+}
+
+static void usage(const char *prog) {
+	die("usage: %s [-b bytes/s] [-l delay-ms] [-j jitter-ms] [-q window-bytes] command [args]", prog);
+}
+
+int main(int argc, char **argv) {
+	double rate = 0, delay_ms = 0, jitter_ms = 0;
+	long window = 16384;
+
+	for (int opt; (opt = getopt(argc, argv, "+b:l:j:q:")) != -1;) {
+		switch (opt) {
+		case 'b': rate = atof(optarg); break;
+		case 'l': delay_ms = atof(optarg); break;
+		case 'j': jitter_ms = atof(optarg); break;
+		case 'q': window = atol(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+
+	if (optind == argc || rate < 0 || delay_ms < 0 || jitter_ms < 0 || window < 1 || window > LINK_CAPACITY)
+		usage(argv[0]);
+
+	int master;
+	const pid_t pid = spawn(argv + optind, &master);
+
+	struct termios saved;
+	const bool tty = isatty(STDIN_FILENO) && !tcgetattr(STDIN_FILENO, &saved);
+	if (tty) {
+		struct termios attr = saved;
+		cfmakeraw(&attr);
+		assert_ok(tcsetattr(STDIN_FILENO, TCSANOW, &attr), "couldn't set terminal attributes");
+	}
+
+	signal(SIGWINCH, on_winch);
+	signal(SIGPIPE, SIG_IGN);
+
+	/* the same link both ways, output is what it's really there for */
+	link_t *down = calloc(1, sizeof(link_t)), *up = calloc(1, sizeof(link_t));
+	assert_ok(!down || !up, "out of memory");
+
+	*down = (link_t){ .in = master, .out = STDOUT_FILENO, .rate = rate,
+		.delay = delay_ms * 1e6, .jitter = jitter_ms * 1e6, .capacity = window };
+	*up = (link_t){ .in = STDIN_FILENO, .out = master, .rate = rate,
+		.delay = delay_ms * 1e6, .jitter = jitter_ms * 1e6, .capacity = window };
+
+	for (;;) {
+		if (window_changed) {
+			window_changed = 0;
+
+			struct winsize ws;
+			if (!ioctl(STDIN_FILENO, TIOCGWINSZ, &ws))
+				ioctl(master, TIOCSWINSZ, &ws);
+		}
+
+		const uint64_t now = now_ns();
+		link_deliver(down, now);
+		link_deliver(up, now);
+
+		/* the command's gone and everything it wrote has arrived */
+		if (down->closed && down->seg_tail == down->seg_head)
+			break;
+
+		const int64_t d = link_next(down, now), u = link_next(up, now);
+		int64_t wait = d < 0 ? u : u < 0 ? d : d < u ? d : u;
+
+		struct pollfd fds[2] = {
+			{ link_can_read(down) ? master : -1, POLLIN, 0 },
+			{ link_can_read(up) ? STDIN_FILENO : -1, POLLIN, 0 },
+		};
+
+		const int timeout = wait < 0 ? -1 : (int)((wait + 999999) / 1000000);
+		if (poll(fds, 2, timeout) < 0)
+			continue;
+
+		if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+			link_read(down);
+		if (fds[1].revents & (POLLIN | POLLHUP | POLLERR))
+			link_read(up);
+	}
+
+	if (tty)
+		tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+
+	int status = 0;
+	waitpid(pid, &status, 0);
+	close(master);
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
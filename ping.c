@@ -1,74 +1,33 @@
+#include <errno.h>
 #include <fcntl.h>
-#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <signal.h>
 #include <unistd.h>
 #include <termios.h>
+#include <time.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
-#define unreachable(func) \
-	do { fprintf(stderr, "unreachable (%s)\n", (func)); abort(); } while(0)
-
-#define die(fmt, ...) \
-	do { fprintf(stderr, fmt __VA_OPT__(,) __VA_ARGS__); fputc('\n', stderr); exit(1); } while(0)
-
-#define assert_ok(ret, fmt, ...) \
-	do { if (ret) { die(fmt __VA_OPT__(,) __VA_ARGS__); } } while(0)
+#include "pong.h"
+#include "pong_counters.h"
+#include "pong_flight.h"
+#include "pong_shm.h"
+#include "pong_tools.h"
 
 #define FRAMERATE(f)	(1000000 / (f))
 
-typedef long double f64;
-
-typedef struct {
-	f64 x, y;
-} vec2;
-
-static inline vec2 vec2_new(const int x, const int y) {
-	return (vec2){ x, y };
-}
-
-static inline f64 vec2_len(const vec2 a) {
-	const f64 x = a.x;
-	const f64 y = a.y;
-
-	return sqrtl((x * x) + (y * y));
-}
-
-static inline vec2 vec2_add(const vec2 a, const vec2 b) {
-	return (vec2){ a.x + b.x, a.y + b.y };
-}
-
-static inline vec2 vec2_sub(const vec2 a, const vec2 b) {
-	return (vec2){ a.x - b.x, a.y - b.y };
-}
-
-static inline vec2 vec2_negate(const vec2 a) {
-	return (vec2){ -a.x, -a.y };
-}
-
-static inline vec2 vec2_rotate(const vec2 a, const f64 degrees) {
-	const f64 radians = degrees * M_PI/180;
-	return (vec2){
-		roundl(cosl(radians) * a.x - sinl(radians) * a.y),
-		roundl(sinl(radians) * a.x + cosl(radians) * a.y),
-	};
-}
-
-typedef struct {
-	uint8_t r, g, b;
-} rgb;
-
-static inline rgb rgb_new(const uint8_t r, const uint8_t g, const uint8_t b) {
-	return (rgb){ r, g, b };
+uint64_t rng_seed_from_clock(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ((uint64_t)ts.tv_sec << 32) ^ (uint64_t)ts.tv_nsec ^ ((uint64_t)getpid() << 16);
 }
 
-#define RGB(col)		(col).r, (col).g, (col).b
-#define WHITE			(rgb){ 0xFF, 0xFF, 0xFF }
-#define BLACK			(rgb){ 0, 0, 0 }
-
-
 void clear(void) {
 	printf("\033[H\033[2J");
 }
@@ -100,11 +59,6 @@ void end_graphics(void) {
 	clear();
 }
 
-void color_cell(const rgb col) {
-	printf("\033[38;2;%u;%u;%um", RGB(col));
-	printf("\033[48;2;%u;%u;%um", RGB(col));
-}
-
 typedef struct {
 	int fd;
 
@@ -119,13 +73,6 @@ tty_ctx_t tty_context;
 #define DISPLAY_WIDTH	(tty_context.cols - 1)
 #define DISPLAY_HEIGHT	(tty_context.rows - 1)
 
-static inline void draw_cell(const vec2 pos, const rgb col, const char pixel) {
-	move(pos);
-	color_cell(col);
-	putchar(pixel);
-	reset_graphics();
-}
-
 void set_dimensions(tty_ctx_t *ctx) {
 	struct winsize ws;
 	assert_ok(ioctl(ctx->fd, TIOCGWINSZ, &ws), "unable to get window size");
@@ -166,148 +113,248 @@ void deinit_tty(tty_ctx_t *ctx) {
 }
 
 
-typedef struct {
-	vec2 pos;
-	vec2 delta;
-	vec2 size;
-} entity_t;
-
-#define MAX_ENTITY_WIDTH	(DISPLAY_WIDTH / 2)
-#define MAX_ENTITY_HEIGHT	(DISPLAY_HEIGHT / 2)
+/* a drag can fire a storm of these, the frame loop picks up the last one */
+volatile sig_atomic_t window_resized;
 
-#define MIN_ENTITY_WIDTH	1
-#define MIN_ENTITY_HEIGHT	1
+void resize_window(int sig) {
+	if (sig != SIGWINCH)
+		return;
 
-#define MAX_ENTITY_DELTA_X	DISPLAY_WIDTH
-#define MAX_ENTITY_DELTA_Y	DISPLAY_HEIGHT
+	window_resized = 1;
+}
 
-#define MIN_ENTITY_DELTA_X	0
-#define MIN_ENTITY_DELTA_Y	0
 
-#define DEFAULT_ENTITY_PROPERTIES \
-	(entity_t){ .pos = (vec2){ 1, 60 }, .size = (vec2){ 2, 1 }, .delta = (vec2){ 0.5, 0.5 } }
+typedef enum {
+	NORMAL,
+	RESIZE,
+	SPEED,
+	SPAWN,
+	REWIND,
+	QUIT,
+} command_state_t;
 
-static inline bool out_of_bounds_x(const f64 x) {
-	return 1 > x || x >= DISPLAY_WIDTH;
-}
-static inline bool out_of_bounds_y(const f64 y) {
-	return 1 > y || y >= DISPLAY_HEIGHT;
-}
-static inline bool out_of_bounds(const vec2 pos) {
-	return out_of_bounds_x(pos.x) || out_of_bounds_y(pos.y);
+const char *command_state_string(const command_state_t s) {
+	switch (s) {
+	case NORMAL: return "normal";
+	case RESIZE: return "resize";
+	case SPEED: return "speed";
+	case SPAWN: return "spawn";
+	case REWIND: return "rewind";
+	case QUIT: return "quit";
+	default: unreachable("command_state_string");
+	}
 }
 
-static inline f64 constrain_x(const f64 x) {
-	return x < 1 ? 1 : x >= DISPLAY_WIDTH ? DISPLAY_WIDTH - 1 : x;
-}
-static inline f64 constrain_y(const f64 y) {
-	return y < 1 ? 1 : y >= DISPLAY_HEIGHT ? DISPLAY_HEIGHT - 1 : y;
-}
-static inline vec2 constrain(const vec2 v) {
-	return (vec2) {
-		constrain_x(v.x),
-		constrain_y(v.y),
-	};
-}
+uint32_t spawn_batch = 1;
 
-static inline bool collision_x(const f64 x) {
-	return 1 >= x || x >= DISPLAY_WIDTH;
-}
-static inline bool collision_y(const f64 y) {
-	return 1 >= y || y >= DISPLAY_HEIGHT;
-}
-static inline bool collision(const vec2 pos) {
-	return collision_x(pos.x) || collision_y(pos.y);
+/* -s: restored at startup if it's there, saved on quit and on 'k' */
+const char *snapshot_path;
+
+/* how the last 'k' went, on the info line until the next one */
+char save_status[96];
+
+#define MAX_SPAWN_BATCH_DIGIT	5
+
+void draw_info_line(pong_ctx_t *ctx, const command_state_t command) {
+	const entity_t *e = pong_get_entity(ctx, ctx->ball);
+
+	move(vec2_new(0, DISPLAY_HEIGHT));
+	clear_line();
+
+	if (e) {
+		const vec2 entity_end = vec2_add(e->pos, e->size);
+		printf("entity((%.3Lf, %.3Lf), (%.3Lf, %.3Lf)) delta(%.3Lf, %.3Lf) ",
+				e->pos.x, e->pos.y,
+				entity_end.x, entity_end.y,
+				e->delta.x, e->delta.y);
+	}
+
+	printf("entities: %u (x%u) display: %d x %d (%s) %s\n",
+			ctx->pool.count, spawn_batch,
+			DISPLAY_WIDTH, DISPLAY_HEIGHT,
+			command_state_string(command), save_status);
 }
 
-void entity_move(entity_t *e) {
-	const vec2 end = vec2_add(e->pos, e->size);
+/* export of the simulation for outside readers, see pong_shm.h */
+typedef struct {
+	const char *name;
+	pong_shm_t *shm;
+} shm_export_t;
 
-	const vec2 new_pos = vec2_add(e->pos, e->delta);
-	const vec2 new_end = vec2_add(end, e->delta);
+shm_export_t shm_export;
 
-	if (collision(new_pos)) {
-		if (collision_x(new_pos.x)) {
-			e->delta.x = -e->delta.x;
-		} else {
-			e->delta.y = -e->delta.y;
-		}
+_Static_assert(sizeof(pong_shm_cell_t) == sizeof(rgb), "cells are exported as they are");
 
-		e->pos = constrain(new_pos);
-	} else if (collision(new_end)) {
-		if (collision_x(new_end.x)) {
-			e->delta.x = -e->delta.x;
-		} else {
-			e->delta.y = -e->delta.y;
-		}
+void shm_export_open(shm_export_t *ex, const char *name) {
+	const int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	assert_ok(fd < 0, "couldn't open shared memory %s", name);
+	assert_ok(ftruncate(fd, sizeof(pong_shm_t)), "couldn't size shared memory %s", name);
 
-		e->pos = vec2_sub(constrain(new_end), e->size);
-	} else {
-		e->pos = new_pos;
-	}
+	ex->shm = mmap(NULL, sizeof(pong_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	assert_ok(ex->shm == MAP_FAILED, "couldn't map shared memory %s", name);
+	close(fd);
+
+	ex->name = name;
+	ex->shm->header.magic = PONG_SHM_MAGIC;
+	ex->shm->header.version = PONG_SHM_VERSION;
 }
 
-void entity_draw(const entity_t *e) {
-	for (int y = e->pos.y; y < e->pos.y + e->size.y; y++) {
-		for (int x = e->pos.x; x < e->pos.x + e->size.x; x++) {
-			// silly ass mistake
-			// const vec2 pos = { x, e->pos.y + y };
-			const vec2 pos = { x, y };
+void shm_export_close(shm_export_t *ex) {
+	if (!ex->shm)
+		return;
 
-			if (out_of_bounds(pos))
-				continue;
+	munmap(ex->shm, sizeof(pong_shm_t));
+	shm_unlink(ex->name);
+	ex->shm = NULL;
+}
 
-			draw_cell(pos, WHITE, ' ');
-		}
+void shm_export_publish(shm_export_t *ex, const pong_ctx_t *ctx) {
+	pong_shm_t *shm = ex->shm;
+	const framebuffer_t *fb = &ctx->framebuffer;
+	const uint64_t seq = pong_shm_write_begin(shm);
+
+	const uint32_t n = ctx->pool.count < PONG_SHM_MAX_ENTITIES ? ctx->pool.count : PONG_SHM_MAX_ENTITIES;
+	for (uint32_t i = 0; i < n; i++) {
+		const entity_t *e = &ctx->pool.entities[i];
+		shm->entities[i] = (pong_shm_entity_t){
+			e->pos.x, e->pos.y,
+			e->delta.x, e->delta.y,
+			e->size.x, e->size.y,
+		};
 	}
-}
 
-void entity_update(entity_t *e) {
-	entity_move(e);
-	entity_draw(e);
+	const size_t cells = (size_t)fb->width * fb->height;
+	const bool export_cells = !ctx->monochrome_enabled && cells <= PONG_SHM_MAX_CELLS;
+	if (export_cells)
+		memcpy(shm->cells, fb->cells, cells * sizeof(rgb));
+
+	shm->header.tick = ctx->tick;
+	shm->header.flags = ctx->monochrome_enabled ? PONG_SHM_MONOCHROME : 0;
+	shm->header.entity_count = n;
+	shm->header.entity_total = ctx->pool.count;
+	shm->header.width = export_cells ? fb->width : 0;
+	shm->header.height = export_cells ? fb->height : 0;
+
+	pong_shm_write_end(shm, seq);
 }
 
+/*
+ * flight recorder, see pong_flight.h. everything the crash path needs is
+ * set up front: the dump path and message are formatted at startup and
+ * the handler only uses open, write, close, tcsetattr and raise. die()
+ * exits, so it's caught with atexit unless main got to clean up.
+ */
+#define FLIGHT_PATH_MAX	64
 
-void resize_window(int sig) {
-	if (sig != SIGWINCH)
+typedef struct {
+	pong_flight_t ring;
+
+	char path[FLIGHT_PATH_MAX];
+	char message[FLIGHT_PATH_MAX + 64];
+	size_t message_len;
+
+	volatile sig_atomic_t armed;
+} flight_recorder_t;
+
+flight_recorder_t flight;
+
+static const int flight_signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT, SIGTERM, SIGHUP };
+
+void flight_dump(const int sig) {
+	if (!flight.armed)
 		return;
-	
-	set_dimensions(&tty_context);
-	clear();
-}
+	flight.armed = 0;
 
+	flight.ring.header.signal = sig;
 
-typedef enum {
-	NORMAL,
-	RESIZE,
-	SPEED,
-	QUIT,
-} command_state_t;
+	const int fd = open(flight.path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	const bool dumped = fd >= 0 && write(fd, &flight.ring, sizeof(flight.ring)) == sizeof(flight.ring);
+	if (fd >= 0)
+		close(fd);
 
-const char *command_state_string(const command_state_t s) {
-	switch (s) {
-	case NORMAL: return "normal";
-	case RESIZE: return "resize";
-	case SPEED: return "speed";
-	case QUIT: return "quit";
-	default: unreachable("command_state_string");
-	}
+	static const char restore[] = "\033[0m\033[?25h\n";
+	tcsetattr(tty_context.fd, TCSANOW, &tty_context.attrs);
+
+	/* nothing left to do if these fail */
+	ssize_t ignored = write(STDOUT_FILENO, restore, sizeof(restore) - 1);
+	if (dumped)
+		ignored = write(STDERR_FILENO, flight.message, flight.message_len);
+	(void)ignored;
 }
 
-void draw_info_line(const entity_t *e, const command_state_t command) {
-	move(vec2_new(0, DISPLAY_HEIGHT));
+void flight_on_signal(const int sig) {
+	flight_dump(sig);
+	raise(sig);
+}
 
-	const vec2 entity_end = vec2_add(e->pos, e->size);
-	printf("entity((%.3Lf, %.3Lf), (%.3Lf, %.3Lf)) delta(%.3Lf, %.3Lf) display: %d x %d (%s)\n",
-			e->pos.x, e->pos.y,
-			entity_end.x, entity_end.y,
-			e->delta.x, e->delta.y,
-			DISPLAY_WIDTH, DISPLAY_HEIGHT,
-			command_state_string(command));
+void flight_on_exit(void) {
+	flight_dump(0);
 }
 
-command_state_t handle_command(const command_state_t command, entity_t *e) {
-	const int c = getchar();
+void flight_open(void) {
+	flight.ring.header = (pong_flight_header_t){
+		.magic = PONG_FLIGHT_MAGIC,
+		.version = PONG_FLIGHT_VERSION,
+		.record_size = sizeof(pong_flight_record_t),
+		.capacity = PONG_FLIGHT_TICKS,
+		.pid = getpid(),
+	};
+
+	snprintf(flight.path, sizeof(flight.path), "/tmp/pong-%d.flight", (int)getpid());
+	flight.message_len = snprintf(flight.message, sizeof(flight.message),
+			"flight recorder dumped to %s\n", flight.path);
+
+	/* its own stack, so a stack overflow still gets dumped */
+	static char altstack[1 << 16];
+	const stack_t ss = { .ss_sp = altstack, .ss_size = sizeof(altstack) };
+	assert_ok(sigaltstack(&ss, NULL), "couldn't set the signal stack");
+
+	struct sigaction sa = { .sa_handler = flight_on_signal, .sa_flags = SA_RESETHAND | SA_ONSTACK };
+	sigemptyset(&sa.sa_mask);
+	for (size_t i = 0; i < sizeof(flight_signals) / sizeof(flight_signals[0]); i++)
+		assert_ok(sigaction(flight_signals[i], &sa, NULL), "couldn't set handler for signal %d", flight_signals[i]);
+
+	assert_ok(atexit(flight_on_exit), "couldn't register the flight recorder");
+	flight.armed = 1;
+}
+
+void flight_close(void) {
+	flight.armed = 0;
+}
+
+/* one slot's worth of plain stores per tick */
+static inline void flight_record(pong_ctx_t *ctx, const command_state_t command, const int key,
+		const uint32_t commands, const pong_op_t last_op, const uint64_t frame_ns) {
+	pong_flight_header_t *h = &flight.ring.header;
+	pong_flight_record_t *r = &flight.ring.records[h->head % PONG_FLIGHT_TICKS];
+	const entity_t *e = pong_get_entity(ctx, ctx->ball);
+
+	*r = (pong_flight_record_t){
+		.tick = ctx->tick,
+		.frame_ns = frame_ns,
+		.frame_bytes = ctx->output.last_frame,
+		.entities = ctx->pool.count,
+		.width = ctx->width,
+		.height = ctx->height,
+		.key = key == EOF ? 0 : key,
+		.mode = command,
+		.commands = commands > UINT8_MAX ? UINT8_MAX : commands,
+		.last_op = last_op,
+	};
+
+	if (e) {
+		r->ball_x = e->pos.x, r->ball_y = e->pos.y;
+		r->ball_dx = e->delta.x, r->ball_dy = e->delta.y;
+		r->ball_w = e->size.x, r->ball_h = e->size.y;
+	}
+
+	__atomic_store_n(&h->head, h->head + 1, __ATOMIC_RELEASE);
+}
+
+command_state_t handle_command(const command_state_t command, const int c, pong_ctx_t *ctx) {
+	if (c != EOF)
+		pong_count(PONG_COUNTER_EVENTS, 1);
+
 	switch (c) {
 	case 'q': return QUIT;
 	case 'n': return NORMAL;
@@ -322,75 +369,456 @@ command_state_t handle_command(const command_state_t command, entity_t *e) {
 			return RESIZE;
 		case 's':
 			return SPEED;
+		case 'e':
+			return SPAWN;
+		case 'z':
+			return REWIND;
+		case 't':
+			pong_set_trails(ctx, !ctx->trails_enabled);
+			break;
+		case 'g':
+			pong_set_gradient(ctx, !ctx->background_gradient);
+			break;
+		case 'b':
+			pong_set_breakout(ctx, !ctx->breakout_enabled);
+			break;
+		case 'f':
+			pong_set_fade(ctx, !ctx->fade_enabled);
+			break;
+		case 'a':
+			pong_set_antialiasing(ctx, !ctx->antialiasing);
+			break;
+		case 'p':
+			pong_set_scoreboard(ctx, !ctx->scoreboard.enabled);
+			break;
+		case 'm':
+			pong_set_monochrome(ctx, !ctx->monochrome_enabled);
+			break;
+		case 'k':
+			/* a full disk or a bad path shouldn't end the game */
+			if (!snapshot_path)
+				break;
+			if (pong_save(ctx, snapshot_path))
+				snprintf(save_status, sizeof(save_status), "couldn't save: %s", strerror(errno));
+			else
+				snprintf(save_status, sizeof(save_status), "saved");
+			break;
 		}
 	} break;
 
 	case RESIZE: {
 		switch (c) {
-		case 'w': {
-			if (e->size.x < MAX_ENTITY_WIDTH && e->size.y < MAX_ENTITY_HEIGHT) {
-				e->size.x++;
-				e->size.y++;
-			}
-		} break;
-
-		case 's': {
-			if (e->size.x > MIN_ENTITY_WIDTH && e->size.y > MIN_ENTITY_HEIGHT) {
-				e->size.x--;
-				e->size.y--;
-			}
-		} break;
+		case 'w': pong_grow(ctx); break;
+		case 's': pong_shrink(ctx); break;
+		case 'c': pong_next_shape(ctx); break;
 		}
 	} break;
 
 	case SPEED: {
 		switch (c) {
-		case 'w': {
-			if (e->delta.x < MAX_ENTITY_DELTA_X && e->delta.y < MAX_ENTITY_DELTA_Y) {
-				e->delta.x = (!e->delta.x + e->delta.x) * 2;
-				e->delta.y = (!e->delta.y + e->delta.y) * 2;
-			}
-		} break;
-
-		case 's': {
-			if (e->delta.x > MIN_ENTITY_DELTA_X && e->delta.y > MIN_ENTITY_DELTA_Y) {
-				e->delta.x /= 2;
-				e->delta.y /= 2;
-			}
-		} break;
+		case 'w': pong_speed_up(ctx); break;
+		case 's': pong_slow_down(ctx); break;
 		}
 	} break;
 
+	case SPAWN: {
+		switch (c) {
+		case 'w': pong_spawn(ctx, spawn_batch); break;
+		case 's': pong_despawn(ctx, spawn_batch); break;
+		}
+
+		if ('0' <= c && c <= '0' + MAX_SPAWN_BATCH_DIGIT) {
+			spawn_batch = 1;
+			for (int i = '0'; i < c; i++)
+				spawn_batch *= 10;
+		}
+	} break;
+
+	case REWIND: {
+		if (c == 'z')
+			return NORMAL;
+	} break;
+
 	default: unreachable("handle_command");
 	}
 
 	return command;
 }
 
-int main(void) {
+/*
+ * control socket: one thread per connection parses lines into commands and
+ * pushes them onto a bounded lock-free queue (vyukov's, with a single
+ * consumer), the game loop drains it at the start of each tick. past
+ * CONTROL_MAX_CONNECTIONS open at once, new ones are turned away.
+ *
+ *   size W H | delta DX DY | spawn N | despawn N | fps N | pause | resume | stats
+ */
+#define CONTROL_QUEUE_SIZE	1024
+#define CONTROL_LINE_MAX	128
+#define CONTROL_MAX_CONNECTIONS	16
+
+typedef struct {
+	uint64_t seq;
+	pong_command_t cmd;
+} control_slot_t;
+
+typedef struct {
+	_Alignas(64) uint64_t head;
+	_Alignas(64) uint64_t tail;
+	control_slot_t slots[CONTROL_QUEUE_SIZE];
+} control_queue_t;
+
+control_queue_t control_queue;
+
+void control_queue_init(control_queue_t *q) {
+	for (uint64_t i = 0; i < CONTROL_QUEUE_SIZE; i++)
+		q->slots[i].seq = i;
+}
+
+bool control_queue_push(control_queue_t *q, const pong_command_t cmd) {
+	uint64_t pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+	control_slot_t *slot;
+
+	for (;;) {
+		slot = &q->slots[pos % CONTROL_QUEUE_SIZE];
+		const int64_t diff = (int64_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+
+		if (diff < 0)
+			return false;
+
+		if (!diff && __atomic_compare_exchange_n(&q->head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+
+		if (diff)
+			pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+	}
+
+	slot->cmd = cmd;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+bool control_queue_pop(control_queue_t *q, pong_command_t *cmd) {
+	control_slot_t *slot = &q->slots[q->tail % CONTROL_QUEUE_SIZE];
+	if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != q->tail + 1)
+		return false;
+
+	*cmd = slot->cmd;
+	__atomic_store_n(&slot->seq, q->tail + CONTROL_QUEUE_SIZE, __ATOMIC_RELEASE);
+	q->tail++;
+
+	return true;
+}
+
+bool control_queue_pending(const control_queue_t *q) {
+	const control_slot_t *slot = &q->slots[q->tail % CONTROL_QUEUE_SIZE];
+	return __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == q->tail + 1;
+}
+
+/* what `stats` reports, published by the game loop behind a seqlock */
+typedef struct {
+	uint64_t seq;
+
+	uint64_t tick;
+	uint32_t entities;
+	int fps;
+	bool paused;
+	uint64_t frame_ns;
+	uint64_t present_ns;
+	uint64_t frame_bytes;
+	uint64_t total_bytes;
+} control_stats_t;
+
+control_stats_t control_stats;
+
+void control_stats_publish(control_stats_t *st, const pong_ctx_t *ctx, const uint64_t frame_ns, const uint64_t present_ns) {
+	const uint64_t seq = st->seq;
+	__atomic_store_n(&st->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	st->tick = ctx->tick;
+	st->entities = ctx->pool.count;
+	st->fps = ctx->tick_rate;
+	st->paused = ctx->paused;
+	st->frame_ns = frame_ns;
+	st->present_ns = present_ns;
+	st->frame_bytes = ctx->output.last_frame;
+	st->total_bytes = ctx->output.written;
+
+	__atomic_store_n(&st->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+control_stats_t control_stats_read(const control_stats_t *st) {
+	control_stats_t copy;
+
+	for (;;) {
+		const uint64_t seq = __atomic_load_n(&st->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		memcpy(&copy, st, sizeof(copy));
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&st->seq, __ATOMIC_RELAXED) == seq)
+			return copy;
+	}
+}
+
+static inline void control_reply(const int fd, const char *msg) {
+	send(fd, msg, strlen(msg), MSG_NOSIGNAL);
+}
+
+void control_handle_line(const int fd, const char *line) {
+	pong_count(PONG_COUNTER_EVENTS, 1);
+
+	/* split into words the way pong_command_parse does, so "statsX" isn't stats */
+	char op[16];
+	if (sscanf(line, "%15s", op) == 1 && !strcmp(op, "stats")) {
+		const control_stats_t st = control_stats_read(&control_stats);
+		char reply[512];
+
+		int len = snprintf(reply, sizeof(reply),
+				"tick %lu entities %u fps %d paused %d frame_ns %lu present_ns %lu frame_bytes %lu total_bytes %lu",
+				(unsigned long)st.tick, st.entities, st.fps, st.paused,
+				(unsigned long)st.frame_ns, (unsigned long)st.present_ns,
+				(unsigned long)st.frame_bytes, (unsigned long)st.total_bytes);
+
+		/* totals since startup, summed over every thread's shard */
+		pong_counters_t counters;
+		pong_counters_read(&counters);
+
+		for (int c = 0; c < PONG_COUNTER_COUNT; c++)
+			len += snprintf(reply + len, sizeof(reply) - len, " %s %lu",
+					pong_counter_names[c], (unsigned long)counters.value[c]);
+		for (int t = 0; t < PONG_TIMER_COUNT; t++)
+			len += snprintf(reply + len, sizeof(reply) - len, " %s_ns %.0f",
+					pong_timer_names[t], counters.timer_calls[t] ? counters.timer_ns[t] / counters.timer_calls[t] : 0.0);
+
+		snprintf(reply + len, sizeof(reply) - len, "\n");
+		control_reply(fd, reply);
+		return;
+	}
+
+	pong_command_t cmd;
+	if (!pong_command_parse(line, &cmd))
+		control_reply(fd, "error: bad command\n");
+	else if (!control_queue_push(&control_queue, cmd))
+		control_reply(fd, "error: queue full\n");
+	else
+		control_reply(fd, "ok\n");
+}
+
+int control_connections;
+
+void *control_connection(void *arg) {
+	const int fd = (intptr_t)arg;
+	char buf[CONTROL_LINE_MAX];
+	size_t len = 0;
+
+	for (;;) {
+		const ssize_t n = read(fd, buf + len, sizeof(buf) - 1 - len);
+		if (n <= 0)
+			break;
+
+		len += n;
+		buf[len] = '\0';
+
+		char *line = buf, *nl;
+		while ((nl = strchr(line, '\n'))) {
+			*nl = '\0';
+			control_handle_line(fd, line);
+			line = nl + 1;
+		}
+
+		len -= line - buf;
+		memmove(buf, line, len);
+
+		if (len == sizeof(buf) - 1) {
+			control_reply(fd, "error: line too long\n");
+			len = 0;
+		}
+	}
+
+	close(fd);
+	__atomic_sub_fetch(&control_connections, 1, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+void *control_listen(void *arg) {
+	const int sock = (intptr_t)arg;
+
+	for (;;) {
+		const int fd = accept(sock, NULL, NULL);
+		if (fd < 0)
+			continue;
+
+		if (__atomic_add_fetch(&control_connections, 1, __ATOMIC_RELAXED) > CONTROL_MAX_CONNECTIONS) {
+			control_reply(fd, "error: too many connections\n");
+			close(fd);
+			__atomic_sub_fetch(&control_connections, 1, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, control_connection, (void *)(intptr_t)fd)) {
+			close(fd);
+			__atomic_sub_fetch(&control_connections, 1, __ATOMIC_RELAXED);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+
+	return NULL;
+}
+
+void control_open(const char *path) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	assert_ok(strlen(path) >= sizeof(addr.sun_path), "control socket path too long: %s", path);
+	strcpy(addr.sun_path, path);
+
+	const int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	assert_ok(sock < 0, "couldn't create control socket");
+
+	unlink(path);
+	assert_ok(bind(sock, (struct sockaddr *)&addr, sizeof(addr)), "couldn't bind control socket %s", path);
+	assert_ok(listen(sock, 8), "couldn't listen on control socket %s", path);
+
+	control_queue_init(&control_queue);
+
+	pthread_t thread;
+	assert_ok(pthread_create(&thread, NULL, control_listen, (void *)(intptr_t)sock), "couldn't start control thread");
+	pthread_detach(thread);
+}
+
+/* sleeps until the next frame's deadline, or starts over if we're behind */
+void frame_wait(uint64_t *deadline, const int fps) {
+	const uint64_t now = now_ns();
+
+	*deadline += 1000 * (uint64_t)FRAMERATE(fps);
+	if (*deadline < now) {
+		*deadline = now;
+		return;
+	}
+
+	const struct timespec ts = { *deadline / 1000000000, *deadline % 1000000000 };
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+		;
+}
+
+void usage(const char *prog) {
+	die("usage: %s [-e /shm-name] [-c control-socket] [-s snapshot]", prog);
+}
+
+int main(int argc, char **argv) {
+	const char *shm_name = NULL;
+	const char *control_path = NULL;
+
+	for (int opt; (opt = getopt(argc, argv, "e:c:s:")) != -1;) {
+		switch (opt) {
+		case 'e': shm_name = optarg; break;
+		case 'c': control_path = optarg; break;
+		case 's': snapshot_path = optarg; break;
+		default: usage(argv[0]);
+		}
+	}
+
+	if (shm_name)
+		shm_export_open(&shm_export, shm_name);
+	if (control_path)
+		control_open(control_path);
+
+	pong_ctx_t *ctx = snapshot_path ? pong_restore(snapshot_path) : NULL;
+	assert_ok(!ctx && snapshot_path && errno != ENOENT, "couldn't restore %s", snapshot_path);
+
 	tty_context = init_tty();
+	flight_open();
 	start_graphics();
 
 	assert_ok(signal(SIGWINCH, resize_window), "couldn't set handler for resize signal");
 
-	entity_t ball = DEFAULT_ENTITY_PROPERTIES;
+	if (ctx)
+		assert_ok(pong_resize(ctx, tty_context.cols, tty_context.rows), "couldn't resize the field");
+	else
+		ctx = pong_new(tty_context.cols, tty_context.rows, rng_seed_from_clock());
+	assert_ok(!ctx, "couldn't create the field");
+	assert_ok(pong_set_rewind(ctx, true), "couldn't make room for rewinding");
+	static char frame[1 << 16];
 
 	command_state_t command = NORMAL;
+	bool speculated = false;
+
+	uint64_t deadline = now_ns();
 
 	for (;;) {
-		clear();
+		const uint64_t frame_start = now_ns();
+
+		/*
+		 * the frame rendered ahead holds unless a command or a resize came in,
+		 * which get applied before the tick. keys are only read after it.
+		 */
+		const bool resized = window_resized;
+		const bool ahead = speculated && !resized && !control_queue_pending(&control_queue);
+		if (ahead)
+			pong_speculate_commit(ctx);
+		else if (speculated)
+			pong_speculate_discard(ctx);
+
+		uint32_t commands = 0;
+		pong_op_t last_op = 0;
+		for (pong_command_t cmd; control_queue_pop(&control_queue, &cmd); commands++) {
+			pong_command(ctx, &cmd);
+			last_op = cmd.op;
+		}
+
+		if (resized) {
+			window_resized = 0;
+			set_dimensions(&tty_context);
+			clear();
+			assert_ok(pong_resize(ctx, tty_context.cols, tty_context.rows), "couldn't resize the field");
+		}
+
+		/* rewinding plays history back a tick per frame until it runs out */
+		if (command == REWIND && !pong_rewind(ctx))
+			command = NORMAL;
+		if (command != REWIND && !ahead)
+			pong_tick(ctx);
 
-		entity_update(&ball);
-		draw_info_line(&ball, command);
+		do {
+			const size_t n = pong_render(ctx, frame, sizeof(frame));
+			fwrite(frame, 1, n, stdout);
+		} while (pong_render_pending(ctx));
 
-		command = handle_command(command, &ball);
+		if (shm_export.shm)
+			shm_export_publish(&shm_export, ctx);
+		draw_info_line(ctx, command);
+		const uint64_t present_ns = now_ns() - frame_start;
+
+		const int key = getchar();
+		command = handle_command(command, key, ctx);
 
 		if (command == QUIT)
 			break;
 
-		usleep(FRAMERATE(60));
+		const uint64_t frame_ns = now_ns() - frame_start;
+		control_stats_publish(&control_stats, ctx, frame_ns, present_ns);
+		flight_record(ctx, command, key, commands, last_op, frame_ns);
+
+		/* the rest of the frame would be slept away, render the next one in it */
+		speculated = command != REWIND && pong_speculate(ctx);
+
+		frame_wait(&deadline, ctx->tick_rate);
 	}
 
+	if (snapshot_path)
+		assert_ok(pong_save(ctx, snapshot_path), "couldn't save %s", snapshot_path);
+
+	flight_close();
 	end_graphics();
 	deinit_tty(&tty_context);
+	shm_export_close(&shm_export);
+	pong_free(ctx);
+
+	if (control_path)
+		unlink(control_path);
 }
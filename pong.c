@@ -0,0 +1,2829 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <float.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pong.h"
+#include "pong_counters.h"
+
+#define DISPLAY_WIDTH(ctx)	((ctx)->width - 1)
+#define DISPLAY_HEIGHT(ctx)	((ctx)->height - 1)
+
+
+#define RNG_BATCH	256
+
+static inline uint64_t rotl(const uint64_t x, const int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+static rng_t rng_new(uint64_t seed) {
+	rng_t r;
+	for (int i = 0; i < 4; i++)
+		r.s[i] = splitmix64(&seed);
+	return r;
+}
+
+/* xoshiro256** with the state kept in registers for the whole batch */
+static void rng_fill(rng_t *r, uint64_t *out, const size_t n) {
+	uint64_t s0 = r->s[0], s1 = r->s[1], s2 = r->s[2], s3 = r->s[3];
+
+	for (size_t i = 0; i < n; i++) {
+		out[i] = rotl(s1 * 5, 7) * 9;
+		const uint64_t t = s1 << 17;
+
+		s2 ^= s0;
+		s3 ^= s1;
+		s1 ^= s2;
+		s0 ^= s3;
+		s2 ^= t;
+		s3 = rotl(s3, 45);
+	}
+
+	r->s[0] = s0, r->s[1] = s1, r->s[2] = s2, r->s[3] = s3;
+}
+
+/* [0, 1) from the top 32 bits or the bottom 32 bits of a draw */
+static inline f64 rng_unit_hi(const uint64_t x) {
+	return (x >> 32) * 0x1.0p-32L;
+}
+static inline f64 rng_unit_lo(const uint64_t x) {
+	return (uint32_t)x * 0x1.0p-32L;
+}
+
+
+/*
+ * row kernels treat a row of packed rgb as plain bytes, every channel gets
+ * the same arithmetic so the 3 byte stride doesn't matter to the vectors.
+ */
+typedef uint8_t u8x16 __attribute__((vector_size(16)));
+typedef uint16_t u16x16 __attribute__((vector_size(32)));
+
+static inline u8x16 load_u8x16(const uint8_t *p) {
+	u8x16 v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline void store_u8x16(uint8_t *p, const u8x16 v) {
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline u8x16 blend_u8x16(const u8x16 dst, const u8x16 src, const uint16_t a) {
+	const u16x16 d = __builtin_convertvector(dst, u16x16);
+	const u16x16 s = __builtin_convertvector(src, u16x16);
+	const u16x16 v = s * a + d * (uint16_t)(0xFF - a) + 0x80;
+	return __builtin_convertvector((v + (v >> 8)) >> 8, u8x16);
+}
+
+static inline u8x16 add_u8x16(const u8x16 a, const u8x16 b) {
+	const u8x16 sum = a + b;
+	return sum | (u8x16)(sum < a);
+}
+
+static void rgb_fill_row(rgb *dst, const rgb col, const int n) {
+	if (n <= 0)
+		return;
+
+	dst[0] = col;
+	for (int k = 1; k < n; k *= 2)
+		memcpy(dst + k, dst, (k < n - k ? k : n - k) * sizeof(rgb));
+}
+
+void rgb_blend_row(rgb *restrict dst, const rgb *restrict src, const int n, const uint8_t alpha) {
+	uint8_t *d = (uint8_t *)dst;
+	const uint8_t *s = (const uint8_t *)src;
+	const size_t bytes = n * sizeof(rgb);
+
+	size_t i = 0;
+	for (; i + sizeof(u8x16) <= bytes; i += sizeof(u8x16))
+		store_u8x16(d + i, blend_u8x16(load_u8x16(d + i), load_u8x16(s + i), alpha));
+	for (; i < bytes; i++)
+		d[i] = blend_u8(d[i], s[i], alpha);
+}
+
+void rgb_add_row(rgb *restrict dst, const rgb *restrict src, const int n) {
+	uint8_t *d = (uint8_t *)dst;
+	const uint8_t *s = (const uint8_t *)src;
+	const size_t bytes = n * sizeof(rgb);
+
+	size_t i = 0;
+	for (; i + sizeof(u8x16) <= bytes; i += sizeof(u8x16))
+		store_u8x16(d + i, add_u8x16(load_u8x16(d + i), load_u8x16(s + i)));
+	for (; i < bytes; i++)
+		d[i] = add_u8(d[i], s[i]);
+}
+
+/* 16.16 fixed point steps from `from` to `to` inclusive */
+static void rgb_gradient_row(rgb *dst, const rgb from, const rgb to, const int n) {
+	if (n <= 0)
+		return;
+
+	const int32_t steps = n > 1 ? n - 1 : 1;
+	const int32_t dr = (to.r - from.r) * 65536 / steps;
+	const int32_t dg = (to.g - from.g) * 65536 / steps;
+	const int32_t db = (to.b - from.b) * 65536 / steps;
+
+	int32_t r = from.r * 65536 + 0x8000;
+	int32_t g = from.g * 65536 + 0x8000;
+	int32_t b = from.b * 65536 + 0x8000;
+
+	for (int i = 0; i < n; i++, r += dr, g += dg, b += db)
+		dst[i] = rgb_new(r >> 16, g >> 16, b >> 16);
+}
+
+
+/* bits [lo, hi) of a word, 0 <= lo < hi <= 64 */
+static inline uint64_t bit_range(const int lo, const int hi) {
+	return (hi == 64 ? ~0ULL : (1ULL << hi) - 1) & (~0ULL << lo);
+}
+
+
+#define FB_FADE_ALPHA	0x40
+
+#define BACKGROUND_GRADIENT_FROM	(rgb){ 0x10, 0x08, 0x30 }
+#define BACKGROUND_GRADIENT_TO		(rgb){ 0x30, 0x08, 0x10 }
+
+static inline rgb *fb_row(const framebuffer_t *fb, rgb *plane, const int y) {
+	return plane + (size_t)(y - 1) * fb->width;
+}
+
+static inline uint8_t *fb_cover_row(const framebuffer_t *fb, const int y) {
+	return fb->cover + (size_t)(y - 1) * fb->width;
+}
+
+static inline uint64_t *fb_opaque_row(const framebuffer_t *fb, const int y) {
+	return fb->opaque + (size_t)(y - 1) * fb->words;
+}
+
+static inline int fb_clip_x(const framebuffer_t *fb, const int x) {
+	return x < 1 ? 1 : x > fb->width - 1 ? fb->width - 1 : x;
+}
+static inline int fb_clip_y(const framebuffer_t *fb, const int y) {
+	return y < 1 ? 1 : y > fb->height - 1 ? fb->height - 1 : y;
+}
+
+static inline bool fb_in_bounds(const framebuffer_t *fb, const int x, const int y) {
+	return 1 <= x && x < fb->width - 1 && 1 <= y && y < fb->height - 1;
+}
+
+/*
+ * realloc that leaves p as it was when it fails and says whether it
+ * worked. never to 0 bytes, which would free p.
+ */
+#define grow(p, size) ({ \
+	const size_t grow_size_ = (size); \
+	void *grown_ = realloc((p), grow_size_ ? grow_size_ : 1); \
+	grown_ ? ((p) = grown_, true) : false; \
+})
+
+static void fb_set_background(framebuffer_t *fb, const bool gradient) {
+	if (fb->height < 2)
+		return;
+
+	if (gradient)
+		rgb_gradient_row(fb->backdrop, BACKGROUND_GRADIENT_FROM, BACKGROUND_GRADIENT_TO, fb->width);
+	else
+		rgb_fill_row(fb->backdrop, BLACK, fb->width);
+
+	for (int y = 1; y <= fb->height; y++)
+		memcpy(fb_row(fb, fb->background, y), fb->backdrop, fb->width * sizeof(rgb));
+}
+
+static void fb_restore_background(framebuffer_t *fb, const int x0, const int x1, const int y) {
+	memcpy(fb_row(fb, fb->background, y) + x0 - 1, fb->backdrop + x0 - 1, (x1 - x0) * sizeof(rgb));
+}
+
+/*
+ * buffers only ever grow, a smaller window reuses them with a tighter
+ * stride. false, at the old size, if they couldn't.
+ */
+static bool fb_resize(framebuffer_t *fb, const int width, const int height) {
+	if (width > fb->capacity_width || height > fb->capacity_height) {
+		const int cap_w = width > fb->capacity_width ? width : fb->capacity_width;
+		const int cap_h = height > fb->capacity_height ? height : fb->capacity_height;
+		const size_t cells = (size_t)cap_w * cap_h;
+
+		if (!grow(fb->cells, cells * sizeof(rgb))
+				|| !grow(fb->front, cells * sizeof(rgb))
+				|| !grow(fb->background, cells * sizeof(rgb))
+				|| !grow(fb->backdrop, cap_w * sizeof(rgb))
+				|| !grow(fb->scratch, cap_w * sizeof(rgb))
+				|| !grow(fb->cover, cells)
+				|| !grow(fb->opaque, (size_t)((cap_w + 63) / 64) * cap_h * sizeof(uint64_t)))
+			return false;
+
+		fb->capacity_width = cap_w;
+		fb->capacity_height = cap_h;
+	}
+
+	fb->width = width;
+	fb->height = height;
+	fb->words = (width + 63) / 64;
+	fb->stale = true;
+
+	return true;
+}
+
+static void fb_free(framebuffer_t *fb) {
+	free(fb->cells);
+	free(fb->front);
+	free(fb->background);
+	free(fb->backdrop);
+	free(fb->scratch);
+	free(fb->cover);
+	free(fb->opaque);
+}
+
+static void fb_begin(framebuffer_t *fb) {
+	const size_t cells = (size_t)fb->width * fb->height;
+
+	memset(fb->cells, 0, cells * sizeof(rgb));
+	memset(fb->cover, 0xFF, cells);
+	memset(fb->opaque, 0, (size_t)fb->words * fb->height * sizeof(uint64_t));
+}
+
+static void fb_fill_rect(framebuffer_t *fb, int x0, int y0, int x1, int y1, const rgb col) {
+	x0 = fb_clip_x(fb, x0), x1 = fb_clip_x(fb, x1);
+	y0 = fb_clip_y(fb, y0), y1 = fb_clip_y(fb, y1);
+	if (x0 >= x1)
+		return;
+
+	const int b0 = x0 - 1, b1 = x1 - 1;
+	const int w0 = b0 >> 6, w1 = (b1 - 1) >> 6;
+
+	for (int y = y0; y < y1; y++) {
+		rgb *cells = fb_row(fb, fb->cells, y);
+		uint8_t *cover = fb_cover_row(fb, y);
+		uint64_t *opaque = fb_opaque_row(fb, y);
+
+		for (int w = w0; w <= w1; w++) {
+			const uint64_t range = bit_range(w == w0 ? b0 & 63 : 0, w == w1 ? ((b1 - 1) & 63) + 1 : 64);
+
+			for (uint64_t visible = range & ~opaque[w]; visible; visible &= visible - 1) {
+				const int i = w * 64 + __builtin_ctzll(visible);
+
+				cells[i] = rgb_add(cells[i], cover[i] == 0xFF ? col : rgb_scale(col, cover[i]));
+				cover[i] = 0;
+			}
+
+			opaque[w] |= range;
+		}
+	}
+}
+
+static inline void fb_blend_cell(framebuffer_t *fb, const int x, const int y, const rgb col, const uint8_t alpha) {
+	if (!fb_in_bounds(fb, x, y))
+		return;
+
+	const int i = x - 1;
+	uint8_t *cover = &fb_cover_row(fb, y)[i];
+	if (!*cover)
+		return;
+
+	const uint8_t visible = blend_u8(0, alpha, *cover);
+	rgb *c = &fb_row(fb, fb->cells, y)[i];
+	*c = rgb_add(*c, rgb_scale(col, visible));
+
+	*cover -= visible;
+	if (!*cover)
+		fb_opaque_row(fb, y)[i >> 6] |= 1ULL << (i & 63);
+}
+
+/* additive light doesn't hide anything behind it */
+static inline void fb_add_cell(framebuffer_t *fb, const int x, const int y, const rgb col) {
+	if (!fb_in_bounds(fb, x, y))
+		return;
+
+	const int i = x - 1;
+	const uint8_t cover = fb_cover_row(fb, y)[i];
+	if (!cover)
+		return;
+
+	rgb *c = &fb_row(fb, fb->cells, y)[i];
+	*c = rgb_add(*c, rgb_scale(col, cover));
+}
+
+/*
+ * the back layer: the background, or the last frame fading toward it.
+ * runs that nothing was drawn over are a single row kernel each.
+ */
+static void fb_composite_background(framebuffer_t *fb, const bool fade) {
+	const int n = fb->width - 2;
+	const bool from_front = fade && !fb->stale;
+
+	for (int y = 1; y < fb->height - 1; y++) {
+		rgb *cells = fb_row(fb, fb->cells, y);
+		const rgb *background = fb_row(fb, fb->background, y);
+		const rgb *front = fb_row(fb, fb->front, y);
+		const uint8_t *cover = fb_cover_row(fb, y);
+		const uint64_t *opaque = fb_opaque_row(fb, y);
+
+		const rgb *base = background;
+		if (from_front) {
+			memcpy(fb->scratch, front, n * sizeof(rgb));
+			rgb_blend_row(fb->scratch, background, n, FB_FADE_ALPHA);
+			base = fb->scratch;
+		}
+
+		for (int x = 0; x < n;) {
+			if (!(x & 63) && opaque[x >> 6] == ~0ULL) {
+				x += 64;
+				continue;
+			}
+
+			if (cover[x] != 0xFF) {
+				if (cover[x])
+					cells[x] = rgb_add(cells[x], rgb_scale(base[x], cover[x]));
+				x++;
+				continue;
+			}
+
+			int end = x + 1;
+			while (end < n && cover[end] == 0xFF)
+				end++;
+
+			rgb_add_row(cells + x, base + x, end - x);
+			x = end;
+		}
+	}
+}
+
+/*
+ * the most a cell can take: a cursor move, a colour and the cell. room is
+ * made a row at a time, with the reset that ends the frame on top, so the
+ * writes in between don't check.
+ */
+#define OUT_MOVE_MAX	24
+#define OUT_CELL_MAX	(OUT_MOVE_MAX + RUN_MAX_SGR + 1)
+
+static inline bool out_reserve(outbuf_t *o, const size_t n) {
+	if (o->len + n <= o->cap)
+		return true;
+
+	const size_t cap = (o->len + n) * 2;
+	if (!grow(o->data, cap))
+		return false;
+
+	o->cap = cap;
+	return true;
+}
+
+static inline bool out_reserve_row(outbuf_t *o, const int cells) {
+	return out_reserve(o, (size_t)cells * OUT_CELL_MAX + sizeof("\033[0m"));
+}
+
+static inline void out_bytes(outbuf_t *o, const void *p, const size_t n) {
+	memcpy(o->data + o->len, p, n);
+	o->len += n;
+}
+
+static inline char *encode_uint(char *p, unsigned v) {
+	char digits[10];
+	int n = 0;
+
+	do {
+		digits[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+
+	while (n)
+		*p++ = digits[--n];
+
+	return p;
+}
+
+static inline void out_move(outbuf_t *o, const int x, const int y) {
+	char *start = o->data + o->len, *p = start;
+
+	*p++ = '\033', *p++ = '[';
+	p = encode_uint(p, y);
+	*p++ = ';';
+	p = encode_uint(p, x);
+	*p++ = 'H';
+
+	o->len += p - start;
+}
+
+/*
+ * a run of same coloured cells encodes to a background colour followed by
+ * spaces, which doesn't depend on where the run is. runs are cached per
+ * (colour, length) so presenting one is a cursor move plus a memcpy.
+ */
+static const encoded_run_t *encoded_run(encoded_run_t *cache, const rgb col, const int cells) {
+	const unsigned key = ((col.r * 31 + col.g) * 31 + col.b) * 131 + cells;
+	encoded_run_t *run = &cache[key % RUN_CACHE_SIZE];
+
+	if (run->cells == cells && rgb_eq(run->col, col))
+		return run;
+
+	char *p = run->data;
+	memcpy(p, "\033[48;2;", 7);
+	p += 7;
+	p = encode_uint(p, col.r);
+	*p++ = ';';
+	p = encode_uint(p, col.g);
+	*p++ = ';';
+	p = encode_uint(p, col.b);
+	*p++ = 'm';
+
+	run->col = col;
+	run->cells = cells;
+	run->sgr_len = p - run->data;
+	memset(p, ' ', cells);
+
+	return run;
+}
+
+static void fb_present(framebuffer_t *fb, encoded_run_t *cache, outbuf_t *o) {
+	const int n = fb->width - 2;
+	if (n <= 0)
+		return;
+
+	int cursor_x = -1, cursor_y = -1;
+	rgb col = BLACK;
+	bool col_set = false;
+	uint64_t drawn = 0;
+
+	int y = 1;
+	for (; y < fb->height - 1; y++) {
+		const rgb *row = fb_row(fb, fb->cells, y);
+		rgb *front = fb_row(fb, fb->front, y);
+
+		if (!fb->stale && !memcmp(row, front, n * sizeof(rgb)))
+			continue;
+
+		/* the rows that don't fit are still different from front next frame */
+		if (!out_reserve_row(o, n))
+			break;
+
+		for (int x = 0; x < n;) {
+			const rgb c = row[x];
+			if (!fb->stale && rgb_eq(c, front[x])) {
+				x++;
+				continue;
+			}
+
+			int end = x + 1;
+			while (end < n && end - x < RUN_MAX_CELLS && rgb_eq(row[end], c)
+					&& (fb->stale || !rgb_eq(row[end], front[end])))
+				end++;
+
+			if (cursor_x != x + 1 || cursor_y != y)
+				out_move(o, x + 1, y);
+
+			const encoded_run_t *run = encoded_run(cache, c, end - x);
+			if (col_set && rgb_eq(c, col))
+				out_bytes(o, run->data + run->sgr_len, run->cells);
+			else
+				out_bytes(o, run->data, run->sgr_len + run->cells);
+
+			cursor_x = end + 1, cursor_y = y;
+			col = c;
+			col_set = true;
+			drawn += end - x;
+			x = end;
+		}
+
+		memcpy(front, row, n * sizeof(rgb));
+	}
+
+	if (col_set)
+		out_bytes(o, "\033[0m", 4);
+
+	pong_count(PONG_COUNTER_CELLS, drawn);
+	fb->stale &= y < fb->height - 1;
+}
+
+
+static const char *const sprite_mask[] = {
+	"  ####  ",
+	" ###### ",
+	"## ## ##",
+	"########",
+	" #    # ",
+	"# #  # #",
+};
+
+#define SPRITE_WIDTH	8
+#define SPRITE_HEIGHT	(int)(sizeof(sprite_mask) / sizeof(sprite_mask[0]))
+
+static inline bool shape_covers(const shape_t shape, const int w, const int h, const int x, const int y) {
+	switch (shape) {
+	case SHAPE_RECT: return true;
+
+	case SHAPE_CIRCLE: {
+		const f64 nx = (2 * x + 1 - w) / (f64)w;
+		const f64 ny = (2 * y + 1 - h) / (f64)h;
+		return w == 1 || h == 1 || nx * nx + ny * ny <= 1;
+	}
+
+	case SHAPE_SPRITE: {
+		const int sx = (2 * x + 1) * SPRITE_WIDTH / (2 * w);
+		const int sy = (2 * y + 1) * SPRITE_HEIGHT / (2 * h);
+		return sprite_mask[sy][sx] == '#';
+	}
+
+	default: return false;
+	}
+}
+
+static void span_table_free(span_table_t *t) {
+	free(t->rows);
+	free(t->spans);
+	free(t);
+}
+
+static span_table_t *span_table_build(const shape_t shape, const int w, const int h) {
+	span_table_t *t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+
+	*t = (span_table_t){
+		.shape = shape,
+		.width = w,
+		.height = h,
+		.rows = malloc((h + 1) * sizeof(uint32_t)),
+		.spans = malloc((size_t)h * ((w + 1) / 2) * sizeof(span_t)),
+	};
+
+	if (!t->rows || !t->spans) {
+		span_table_free(t);
+		return NULL;
+	}
+
+	uint32_t n = 0;
+	for (int y = 0; y < h; y++) {
+		t->rows[y] = n;
+
+		for (int x = 0; x < w;) {
+			if (!shape_covers(shape, w, h, x, y)) {
+				x++;
+				continue;
+			}
+
+			const int start = x;
+			while (x < w && shape_covers(shape, w, h, x, y))
+				x++;
+
+			t->spans[n++] = (span_t){ start, x - start };
+		}
+	}
+	t->rows[h] = n;
+
+	return t;
+}
+
+static const span_table_t *span_table_get(pong_ctx_t *ctx, const shape_t shape, const vec2 size) {
+	const int w = size.x, h = size.y;
+	const unsigned bucket = ((unsigned)shape * 31 + w) * 131 + h;
+
+	span_table_t **head = &ctx->span_cache[bucket % SPAN_CACHE_BUCKETS];
+	for (span_table_t *t = *head; t; t = t->next) {
+		if (t->shape == shape && t->width == w && t->height == h)
+			return t;
+	}
+
+	span_table_t *t = span_table_build(shape, w, h);
+	if (!t)
+		return NULL;
+
+	/* antialiasing covers a row of the widest table, one cell past it */
+	if (w + 1 > ctx->aa_coverage_cells) {
+		if (!grow(ctx->aa_coverage, (w + 1) * sizeof(uint32_t))) {
+			span_table_free(t);
+			return NULL;
+		}
+
+		ctx->aa_coverage_cells = w + 1;
+	}
+
+	t->next = *head;
+	*head = t;
+
+	return t;
+}
+
+static void span_cache_free(pong_ctx_t *ctx) {
+	for (int i = 0; i < SPAN_CACHE_BUCKETS; i++) {
+		for (span_table_t *t = ctx->span_cache[i], *next; t; t = next) {
+			next = t->next;
+			span_table_free(t);
+		}
+	}
+}
+
+
+#define MAX_ENTITY_WIDTH(ctx)	(DISPLAY_WIDTH(ctx) / 2)
+#define MAX_ENTITY_HEIGHT(ctx)	(DISPLAY_HEIGHT(ctx) / 2)
+
+#define MIN_ENTITY_WIDTH	1
+#define MIN_ENTITY_HEIGHT	1
+
+#define MAX_ENTITY_DELTA_X(ctx)	DISPLAY_WIDTH(ctx)
+#define MAX_ENTITY_DELTA_Y(ctx)	DISPLAY_HEIGHT(ctx)
+
+#define MIN_ENTITY_DELTA_X	0
+#define MIN_ENTITY_DELTA_Y	0
+
+#define DEFAULT_ENTITY_PROPERTIES \
+	(entity_t){ .pos = (vec2){ 1, 60 }, .size = (vec2){ 2, 1 }, .delta = (vec2){ 0.5, 0.5 }, .shape = SHAPE_RECT }
+
+static inline f64 constrain_x(const pong_ctx_t *ctx, const f64 x) {
+	return x < 1 ? 1 : x >= DISPLAY_WIDTH(ctx) ? DISPLAY_WIDTH(ctx) - 1 : x;
+}
+static inline f64 constrain_y(const pong_ctx_t *ctx, const f64 y) {
+	return y < 1 ? 1 : y >= DISPLAY_HEIGHT(ctx) ? DISPLAY_HEIGHT(ctx) - 1 : y;
+}
+static inline vec2 constrain(const pong_ctx_t *ctx, const vec2 v) {
+	return (vec2) {
+		constrain_x(ctx, v.x),
+		constrain_y(ctx, v.y),
+	};
+}
+
+static inline bool collision_x(const pong_ctx_t *ctx, const f64 x) {
+	return 1 >= x || x >= DISPLAY_WIDTH(ctx);
+}
+static inline bool collision_y(const pong_ctx_t *ctx, const f64 y) {
+	return 1 >= y || y >= DISPLAY_HEIGHT(ctx);
+}
+static inline bool collision(const pong_ctx_t *ctx, const vec2 pos) {
+	return collision_x(ctx, pos.x) || collision_y(ctx, pos.y);
+}
+
+static void entity_move(const pong_ctx_t *ctx, entity_t *e) {
+	const vec2 end = vec2_add(e->pos, e->size);
+
+	const vec2 new_pos = vec2_add(e->pos, e->delta);
+	const vec2 new_end = vec2_add(end, e->delta);
+
+	e->hits = 0;
+
+	if (collision(ctx, new_pos)) {
+		if (collision_x(ctx, new_pos.x)) {
+			e->delta.x = -e->delta.x;
+			e->hits |= WALL_LEFT;
+		} else {
+			e->delta.y = -e->delta.y;
+			e->hits |= WALL_TOP;
+		}
+
+		e->pos = constrain(ctx, new_pos);
+	} else if (collision(ctx, new_end)) {
+		if (collision_x(ctx, new_end.x)) {
+			e->delta.x = -e->delta.x;
+			e->hits |= WALL_RIGHT;
+		} else {
+			e->delta.y = -e->delta.y;
+			e->hits |= WALL_BOTTOM;
+		}
+
+		e->pos = vec2_sub(constrain(ctx, new_end), e->size);
+	} else {
+		e->pos = new_pos;
+	}
+}
+
+/* false, with the entity as it was, if there's no memory for its spans */
+static bool entity_reshape(pong_ctx_t *ctx, entity_t *e, const shape_t shape, const vec2 size) {
+	const span_table_t *spans = span_table_get(ctx, shape, size);
+	if (!spans)
+		return false;
+
+	e->shape = shape;
+	e->size = size;
+	e->spans = spans;
+
+	return true;
+}
+
+/* after a resize: shrink what no longer fits and pull it back inside the walls */
+static void entity_fit(pong_ctx_t *ctx, entity_t *e) {
+	const f64 max_x = MAX_ENTITY_WIDTH(ctx) > MIN_ENTITY_WIDTH ? MAX_ENTITY_WIDTH(ctx) : MIN_ENTITY_WIDTH;
+	const f64 max_y = MAX_ENTITY_HEIGHT(ctx) > MIN_ENTITY_HEIGHT ? MAX_ENTITY_HEIGHT(ctx) : MIN_ENTITY_HEIGHT;
+
+	if (e->size.x > max_x || e->size.y > max_y) {
+		const vec2 size = { e->size.x > max_x ? max_x : e->size.x, e->size.y > max_y ? max_y : e->size.y };
+		entity_reshape(ctx, e, e->shape, size);
+	}
+
+	e->pos = constrain(ctx, vec2_sub(constrain(ctx, vec2_add(e->pos, e->size)), e->size));
+}
+
+/*
+ * coverage is in 1/AA_ONE of a cell per axis, a cell's coverage is the
+ * product of both axes. the alpha table maps it back to gamma space so
+ * partly covered edges don't look too dark.
+ */
+#define AA_GAMMA	2.2L
+
+static void aa_init(pong_ctx_t *ctx) {
+	for (int i = 0; i <= AA_ONE; i++)
+		ctx->aa_alpha[i] = roundl(0xFF * powl((f64)i / AA_ONE, 1 / AA_GAMMA));
+}
+
+/* adds one row of spans shifted right by fx, weighted by wy */
+static inline void aa_cover_row(uint32_t *coverage, const span_table_t *t, const int row, const uint32_t fx, const uint32_t wy) {
+	if (row < 0 || row >= t->height || !wy)
+		return;
+
+	for (const span_t *span = t->spans + t->rows[row]; span < t->spans + t->rows[row + 1]; span++) {
+		uint32_t *c = coverage + span->start;
+
+		c[0] += (AA_ONE - fx) * wy;
+		for (int i = 1; i < span->len; i++)
+			c[i] += AA_ONE * wy;
+		c[span->len] += fx * wy;
+	}
+}
+
+static void entity_draw_antialiased(pong_ctx_t *ctx, const entity_t *e, const rgb col) {
+	const span_table_t *t = e->spans;
+	const int x = floorl(e->pos.x), y = floorl(e->pos.y);
+	const uint32_t fx = (e->pos.x - x) * AA_ONE;
+	const uint32_t fy = (e->pos.y - y) * AA_ONE;
+
+	const int cells = t->width + 1;
+	uint32_t *coverage = ctx->aa_coverage;
+
+	for (int row = 0; row <= t->height; row++) {
+		memset(coverage, 0, cells * sizeof(uint32_t));
+		aa_cover_row(coverage, t, row, fx, AA_ONE - fy);
+		aa_cover_row(coverage, t, row - 1, fx, fy);
+
+		for (int i = 0; i < cells;) {
+			const uint32_t c = coverage[i] >> AA_SHIFT;
+
+			if (c < AA_ONE) {
+				if (c)
+					fb_blend_cell(&ctx->framebuffer, x + i, y + row, col, ctx->aa_alpha[c]);
+				i++;
+				continue;
+			}
+
+			const int start = i;
+			while (i < cells && coverage[i] >> AA_SHIFT >= AA_ONE)
+				i++;
+
+			fb_fill_rect(&ctx->framebuffer, x + start, y + row, x + i, y + row + 1, col);
+		}
+	}
+}
+
+static void entity_draw(pong_ctx_t *ctx, const entity_t *e) {
+	if (ctx->antialiasing) {
+		entity_draw_antialiased(ctx, e, WHITE);
+		return;
+	}
+
+	const int x = e->pos.x, y = e->pos.y;
+
+	for_each_span(e->spans, row, span)
+		fb_fill_rect(&ctx->framebuffer, x + span->start, y + row, x + span->start + span->len, y + row + 1, WHITE);
+}
+
+
+#define BRICK_WIDTH	4
+#define BRICK_TOP	2
+
+static const rgb brick_colors[] = {
+	{ 0xE0, 0x30, 0x30 },
+	{ 0xE0, 0x90, 0x20 },
+	{ 0xE0, 0xD0, 0x20 },
+	{ 0x30, 0xC0, 0x40 },
+	{ 0x30, 0x70, 0xE0 },
+	{ 0x90, 0x40, 0xD0 },
+};
+
+#define BRICK_COLORS	(sizeof(brick_colors) / sizeof(brick_colors[0]))
+
+static inline uint64_t *brick_row(const brick_field_t *f, const int y) {
+	return f->bits + (size_t)(y - 1) * f->words;
+}
+
+static inline bool brick_at(const brick_field_t *f, const int x, const int y) {
+	const int b = x - 1;
+	return 1 <= x && x < f->width - 1 && (brick_row(f, y)[b >> 6] >> (b & 63)) & 1;
+}
+
+/* false, with the field as it was, if there's no memory for the new one */
+static bool bricks_build(brick_field_t *f, const int width, const int height) {
+	const int words = (width + 63) / 64;
+	if (!grow(f->bits, (size_t)words * height * sizeof(uint64_t)))
+		return false;
+
+	f->width = width;
+	f->height = height;
+	f->words = words;
+	memset(f->bits, 0, (size_t)f->words * height * sizeof(uint64_t));
+	f->count = 0;
+
+	const int rows = (height - 2) / 3;
+	for (int y = BRICK_TOP; y < BRICK_TOP + rows && y < height - 1; y += 2) {
+		uint64_t *row = brick_row(f, y);
+
+		for (int x = 1; x + BRICK_WIDTH <= width - 1; x += BRICK_WIDTH + 1) {
+			for (int b = x - 1; b < x - 1 + BRICK_WIDTH; b++)
+				row[b >> 6] |= 1ULL << (b & 63);
+
+			f->count++;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * a fresh field for the new size without the bricks that were already
+ * broken in the old one. bricks sit at the same cells whatever the size,
+ * the size only says where they stop, so every brick of the new field
+ * either was one of the old or is new.
+ */
+static bool bricks_resize(brick_field_t *f, const int width, const int height) {
+	if (f->width == width && f->height == height)
+		return true;
+
+	brick_field_t broken = { 0 };
+	if (!bricks_build(&broken, f->width, f->height))
+		return false;
+
+	const size_t old_words = (size_t)f->words * f->height;
+	for (size_t i = 0; i < old_words; i++)
+		broken.bits[i] &= ~f->bits[i];
+
+	if (!bricks_build(f, width, height)) {
+		free(broken.bits);
+		return false;
+	}
+
+	const int rows = height < broken.height ? height : broken.height;
+	const int words = f->words < broken.words ? f->words : broken.words;
+	uint32_t cells = 0;
+	for (int y = 1; y < f->height - 1; y++) {
+		uint64_t *row = brick_row(f, y);
+
+		for (int w = 0; w < f->words; w++) {
+			if (y < rows - 1 && w < words)
+				row[w] &= ~brick_row(&broken, y)[w];
+			cells += __builtin_popcountll(row[w]);
+		}
+	}
+
+	f->count = cells / BRICK_WIDTH;
+	free(broken.bits);
+
+	return true;
+}
+
+static inline rgb brick_color(const int y) {
+	return brick_colors[(y - BRICK_TOP) / 2 % BRICK_COLORS];
+}
+
+static void bricks_paint(const brick_field_t *f, framebuffer_t *fb) {
+	for (int y = 1; y < f->height - 1; y++) {
+		const uint64_t *row = brick_row(f, y);
+		rgb *cells = fb_row(fb, fb->background, y);
+
+		for (int w = 0; w < f->words; w++) {
+			for (uint64_t bits = row[w]; bits; bits &= bits - 1)
+				cells[w * 64 + __builtin_ctzll(bits)] = brick_color(y);
+		}
+	}
+}
+
+/* any brick in the cells [x0, x1) x [y0, y1), a word of the row at a time */
+static bool bricks_hit(const brick_field_t *f, int x0, int y0, int x1, int y1) {
+	x0 = x0 < 1 ? 1 : x0, x1 = x1 > f->width - 1 ? f->width - 1 : x1;
+	y0 = y0 < 1 ? 1 : y0, y1 = y1 > f->height - 1 ? f->height - 1 : y1;
+	if (x0 >= x1)
+		return false;
+
+	const int b0 = x0 - 1, b1 = x1 - 1;
+	const int w0 = b0 >> 6, w1 = (b1 - 1) >> 6;
+
+	for (int y = y0; y < y1; y++) {
+		const uint64_t *row = brick_row(f, y);
+
+		for (int w = w0; w <= w1; w++) {
+			const int lo = w == w0 ? b0 & 63 : 0;
+			const int hi = w == w1 ? ((b1 - 1) & 63) + 1 : 64;
+
+			if (row[w] & bit_range(lo, hi))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/* clears the whole brick under (x, y) and restores the cells behind it */
+static void brick_break(brick_field_t *f, framebuffer_t *fb, const int x, const int y) {
+	int start = x, end = x + 1;
+	while (brick_at(f, start - 1, y))
+		start--;
+	while (brick_at(f, end, y))
+		end++;
+
+	uint64_t *row = brick_row(f, y);
+	for (int b = start - 1; b < end - 1; b++)
+		row[b >> 6] &= ~(1ULL << (b & 63));
+
+	fb_restore_background(fb, start, end, y);
+	f->count--;
+}
+
+static uint32_t bricks_break(brick_field_t *f, framebuffer_t *fb, int x0, int y0, int x1, int y1) {
+	x0 = x0 < 1 ? 1 : x0, x1 = x1 > f->width - 1 ? f->width - 1 : x1;
+	y0 = y0 < 1 ? 1 : y0, y1 = y1 > f->height - 1 ? f->height - 1 : y1;
+
+	uint32_t broken = 0;
+	for (int y = y0; y < y1; y++) {
+		for (int x = x0; x < x1; x++) {
+			if (!brick_at(f, x, y))
+				continue;
+
+			brick_break(f, fb, x, y);
+			broken++;
+		}
+	}
+
+	return broken;
+}
+
+static inline bool entity_hits_bricks(const brick_field_t *f, const entity_t *e, const vec2 pos) {
+	const int x = pos.x, y = pos.y;
+
+	for_each_span(e->spans, row, span) {
+		if (bricks_hit(f, x + span->start, y + row, x + span->start + span->len, y + row + 1))
+			return true;
+	}
+
+	return false;
+}
+
+static bool entity_collide_bricks(pong_ctx_t *ctx, entity_t *e, const vec2 prev) {
+	const brick_field_t *f = &ctx->bricks;
+	if (!entity_hits_bricks(f, e, e->pos))
+		return false;
+
+	const bool hit_x = entity_hits_bricks(f, e, (vec2){ e->pos.x, prev.y });
+	const bool hit_y = entity_hits_bricks(f, e, (vec2){ prev.x, e->pos.y });
+
+	if (hit_x || !hit_y)
+		e->delta.x = -e->delta.x;
+	if (hit_y || !hit_x)
+		e->delta.y = -e->delta.y;
+
+	const int x = e->pos.x, y = e->pos.y;
+	for_each_span(e->spans, row, span)
+		bricks_break(&ctx->bricks, &ctx->framebuffer, x + span->start, y + row, x + span->start + span->len, y + row + 1);
+
+	e->pos = prev;
+	return true;
+}
+
+/* whether it hit anything, wall or brick */
+static bool entity_update(pong_ctx_t *ctx, entity_t *e) {
+	const vec2 prev = e->pos;
+
+	entity_move(ctx, e);
+	const bool brick = ctx->breakout_enabled && entity_collide_bricks(ctx, e, prev);
+
+	return e->hits || brick;
+}
+
+
+#define SPAWN_DELTA_MIN		0.25L
+#define SPAWN_DELTA_MAX		1.0L
+
+static inline uint32_t entity_pool_slot(entity_pool_t *pool) {
+	if (pool->free_count)
+		return pool->free[--pool->free_count];
+
+	return pool->slots_used++;
+}
+
+entity_handle_t pong_add_entity(pong_ctx_t *ctx, entity_t e) {
+	entity_pool_t *pool = &ctx->pool;
+	if (pool->count == MAX_ENTITIES)
+		return errno = ENOSPC, ENTITY_HANDLE_NONE;
+
+	if (!entity_reshape(ctx, &e, e.shape, e.size))
+		return ENTITY_HANDLE_NONE;
+
+	const uint32_t slot = entity_pool_slot(pool);
+	const uint32_t i = pool->count++;
+
+	pool->entities[i] = e;
+	pool->owner[i] = slot;
+	pool->dense[slot] = i;
+
+	return (entity_handle_t){ slot, pool->generation[slot] };
+}
+
+entity_t *pong_get_entity(pong_ctx_t *ctx, const entity_handle_t h) {
+	entity_pool_t *pool = &ctx->pool;
+	if (h.index >= pool->slots_used || pool->generation[h.index] != h.generation)
+		return NULL;
+
+	return &pool->entities[pool->dense[h.index]];
+}
+
+static inline void entity_pool_release(entity_pool_t *pool, const uint32_t slot) {
+	pool->generation[slot]++;
+	pool->free[pool->free_count++] = slot;
+}
+
+void pong_remove_entity(pong_ctx_t *ctx, const entity_handle_t h) {
+	entity_pool_t *pool = &ctx->pool;
+	if (!pong_get_entity(ctx, h))
+		return;
+
+	const uint32_t i = pool->dense[h.index];
+	const uint32_t last = --pool->count;
+
+	if (i != last) {
+		pool->entities[i] = pool->entities[last];
+		pool->owner[i] = pool->owner[last];
+		pool->dense[pool->owner[i]] = i;
+	}
+
+	entity_pool_release(pool, h.index);
+}
+
+static inline f64 spawn_delta(const f64 unit, const bool negative) {
+	const f64 d = SPAWN_DELTA_MIN + unit * (SPAWN_DELTA_MAX - SPAWN_DELTA_MIN);
+	return negative ? -d : d;
+}
+
+uint32_t pong_spawn(pong_ctx_t *ctx, uint32_t n) {
+	entity_pool_t *pool = &ctx->pool;
+	const uint32_t room = MAX_ENTITIES - pool->count;
+	if (n > room)
+		n = room;
+
+	const vec2 size = DEFAULT_ENTITY_PROPERTIES.size;
+	const shape_t shape = DEFAULT_ENTITY_PROPERTIES.shape;
+	/* cached since pong_new added the ball */
+	const span_table_t *spans = span_table_get(ctx, shape, size);
+	if (!spans)
+		return 0;
+
+	const f64 span_x = DISPLAY_WIDTH(ctx) - 1 - size.x > 0 ? DISPLAY_WIDTH(ctx) - 1 - size.x : 0;
+	const f64 span_y = DISPLAY_HEIGHT(ctx) - 1 - size.y > 0 ? DISPLAY_HEIGHT(ctx) - 1 - size.y : 0;
+
+	uint64_t batch[RNG_BATCH];
+
+	for (uint32_t done = 0; done < n;) {
+		const uint32_t todo = n - done < RNG_BATCH / 2 ? n - done : RNG_BATCH / 2;
+		rng_fill(&ctx->rng, batch, todo * 2);
+
+		for (uint32_t i = 0; i < todo; i++) {
+			const uint64_t a = batch[2 * i];
+			const uint64_t b = batch[2 * i + 1];
+
+			const uint32_t slot = entity_pool_slot(pool);
+			const uint32_t d = pool->count++;
+
+			pool->entities[d] = (entity_t){
+				.pos = { 1 + floorl(rng_unit_hi(a) * span_x), 1 + floorl(rng_unit_lo(a) * span_y) },
+				.size = size,
+				.delta = {
+					spawn_delta(rng_unit_hi(b), b & 1),
+					spawn_delta(rng_unit_lo(b), b & 2),
+				},
+				.shape = shape,
+				.spans = spans,
+			};
+			pool->owner[d] = slot;
+			pool->dense[slot] = d;
+		}
+
+		done += todo;
+	}
+
+	return n;
+}
+
+/* drops the most recently spawned entities, nothing has to be moved */
+uint32_t pong_despawn(pong_ctx_t *ctx, uint32_t n) {
+	entity_pool_t *pool = &ctx->pool;
+	if (n > pool->count)
+		n = pool->count;
+
+	for (uint32_t i = 0; i < n; i++)
+		entity_pool_release(pool, pool->owner[--pool->count]);
+
+	return n;
+}
+
+
+#define TRAIL_MASK	(TRAIL_CAPACITY - 1)
+
+static void trails_init(pong_ctx_t *ctx) {
+	for (int i = 0; i < TRAIL_LIFETIME; i++) {
+		const uint8_t level = 0xFF * (TRAIL_LIFETIME - i) / TRAIL_LIFETIME;
+		ctx->trail_fade[i] = rgb_new(level, level, level);
+	}
+}
+
+static void trails_clear(trail_pool_t *t) {
+	t->tail = t->head;
+}
+
+static inline void trails_emit(trail_pool_t *t, const int x, const int y) {
+	if (t->head - t->tail == TRAIL_CAPACITY)
+		t->tail++;
+
+	const uint32_t i = t->head++ & TRAIL_MASK;
+	t->x[i] = x;
+	t->y[i] = y;
+	t->age[i] = 0;
+}
+
+static void trails_emit_entity(trail_pool_t *t, const entity_t *e) {
+	const int x = e->pos.x, y = e->pos.y;
+
+	for_each_span(e->spans, row, span) {
+		for (int i = 0; i < span->len; i++)
+			trails_emit(t, x + span->start + i, y + row);
+	}
+}
+
+static void trails_update(trail_pool_t *t) {
+	const uint32_t live = t->head - t->tail;
+	const uint32_t start = t->tail & TRAIL_MASK;
+	const uint32_t first = live < TRAIL_CAPACITY - start ? live : TRAIL_CAPACITY - start;
+
+	for (uint32_t i = start; i < start + first; i++)
+		t->age[i]++;
+	for (uint32_t i = 0; i < live - first; i++)
+		t->age[i]++;
+
+	while (t->tail != t->head && t->age[t->tail & TRAIL_MASK] >= TRAIL_LIFETIME)
+		t->tail++;
+}
+
+static void trails_draw(pong_ctx_t *ctx) {
+	const trail_pool_t *t = &ctx->trails;
+
+	for (uint32_t n = t->tail; n != t->head; n++) {
+		const uint32_t i = n & TRAIL_MASK;
+		fb_add_cell(&ctx->framebuffer, t->x[i], t->y[i], ctx->trail_fade[t->age[i]]);
+	}
+}
+
+static void trails_step(trail_pool_t *t, const entity_pool_t *pool) {
+	trails_update(t);
+
+	for (uint32_t i = 0; i < pool->count; i++)
+		trails_emit_entity(t, &pool->entities[i]);
+}
+
+
+/*
+ * block digits, each glyph is rasterised once into spans. the score is laid
+ * out into rects only when it changes, and since the presenter only sends
+ * changed cells an unchanged score costs nothing on the wire.
+ */
+#define GLYPH_WIDTH		3
+#define GLYPH_HEIGHT		5
+#define GLYPH_SCALE_X		2
+#define GLYPH_GAP		2
+
+#define SCORE_TOP		2
+#define SCORE_COLOR		(rgb){ 0xC0, 0xC0, 0xC0 }
+
+static const char *const digit_glyphs[10][GLYPH_HEIGHT] = {
+	{ "###", "# #", "# #", "# #", "###" },
+	{ "  #", "  #", "  #", "  #", "  #" },
+	{ "###", "  #", "###", "#  ", "###" },
+	{ "###", "  #", "###", "  #", "###" },
+	{ "# #", "# #", "###", "  #", "  #" },
+	{ "###", "#  ", "###", "  #", "###" },
+	{ "###", "#  ", "###", "# #", "###" },
+	{ "###", "  #", "  #", "  #", "  #" },
+	{ "###", "# #", "###", "# #", "###" },
+	{ "###", "# #", "###", "  #", "###" },
+};
+
+static bool digits_init(pong_ctx_t *ctx) {
+	for (int d = 0; d < 10; d++) {
+		span_table_t *t = &ctx->digit_spans[d];
+		*t = (span_table_t){
+			.width = GLYPH_WIDTH * GLYPH_SCALE_X,
+			.height = GLYPH_HEIGHT,
+			.rows = malloc((GLYPH_HEIGHT + 1) * sizeof(uint32_t)),
+			.spans = malloc(GLYPH_HEIGHT * (GLYPH_WIDTH + 1) / 2 * sizeof(span_t)),
+		};
+
+		if (!t->rows || !t->spans)
+			return false;
+
+		uint32_t n = 0;
+		for (int y = 0; y < GLYPH_HEIGHT; y++) {
+			const char *row = digit_glyphs[d][y];
+			t->rows[y] = n;
+
+			for (int x = 0; x < GLYPH_WIDTH;) {
+				if (row[x] != '#') {
+					x++;
+					continue;
+				}
+
+				const int start = x;
+				while (x < GLYPH_WIDTH && row[x] == '#')
+					x++;
+
+				t->spans[n++] = (span_t){ start * GLYPH_SCALE_X, (x - start) * GLYPH_SCALE_X };
+			}
+		}
+		t->rows[GLYPH_HEIGHT] = n;
+	}
+
+	return true;
+}
+
+static inline int number_width(uint32_t n) {
+	int digits = 1;
+	while (n >= 10)
+		n /= 10, digits++;
+
+	return digits * (GLYPH_WIDTH * GLYPH_SCALE_X + GLYPH_GAP) - GLYPH_GAP;
+}
+
+static void scoreboard_layout_number(scoreboard_t *sb, const span_table_t *digits, uint32_t n, const int x0) {
+	int x = x0 + number_width(n) - GLYPH_WIDTH * GLYPH_SCALE_X;
+
+	do {
+		const span_table_t *t = &digits[n % 10];
+		for_each_span(t, row, span) {
+			if (sb->rect_count == SCORE_MAX_RECTS)
+				return;
+
+			sb->rects[sb->rect_count++] = (rect_t){
+				x + span->start, SCORE_TOP + row,
+				x + span->start + span->len, SCORE_TOP + row + 1,
+			};
+		}
+
+		x -= GLYPH_WIDTH * GLYPH_SCALE_X + GLYPH_GAP;
+		n /= 10;
+	} while (n);
+}
+
+static void scoreboard_layout(scoreboard_t *sb, const span_table_t *digits, const int width) {
+	const int centre = width / 2;
+
+	sb->rect_count = 0;
+	scoreboard_layout_number(sb, digits, sb->left, centre - GLYPH_GAP * 2 - number_width(sb->left));
+	scoreboard_layout_number(sb, digits, sb->right, centre + GLYPH_GAP * 2);
+	sb->dirty = false;
+}
+
+/* the ball going past a side scores for the other side */
+static void scoreboard_score(scoreboard_t *sb, const uint8_t hits) {
+	if (hits & WALL_LEFT)
+		sb->right++, sb->dirty = true;
+	if (hits & WALL_RIGHT)
+		sb->left++, sb->dirty = true;
+}
+
+static void scoreboard_draw(pong_ctx_t *ctx) {
+	scoreboard_t *sb = &ctx->scoreboard;
+	framebuffer_t *fb = &ctx->framebuffer;
+
+	if (sb->dirty)
+		scoreboard_layout(sb, ctx->digit_spans, fb->width);
+
+	for (int i = 0; i < sb->rect_count; i++) {
+		const rect_t r = sb->rects[i];
+		fb_fill_rect(fb, r.x0, r.y0, r.x1, r.y1, SCORE_COLOR);
+	}
+}
+
+
+static const char spaces[64] = "                                                                ";
+
+static inline uint64_t *bp_row(const bitplane_t *bp, uint64_t *plane, const int y) {
+	return plane + (size_t)(y - 1) * bp->words;
+}
+
+static bool bp_resize(bitplane_t *bp, const int width, const int height) {
+	if (width > bp->capacity_width || height > bp->capacity_height) {
+		const int cap_w = width > bp->capacity_width ? width : bp->capacity_width;
+		const int cap_h = height > bp->capacity_height ? height : bp->capacity_height;
+		const size_t words = (size_t)((cap_w + 63) / 64) * cap_h;
+
+		if (!grow(bp->bits, words * sizeof(uint64_t)) || !grow(bp->front, words * sizeof(uint64_t)))
+			return false;
+
+		bp->capacity_width = cap_w;
+		bp->capacity_height = cap_h;
+	}
+
+	bp->width = width;
+	bp->height = height;
+	bp->words = (width + 63) / 64;
+	bp->stale = true;
+
+	return true;
+}
+
+static void bp_begin(bitplane_t *bp, const brick_field_t *bricks) {
+	const size_t words = (size_t)bp->words * bp->height;
+
+	if (bricks && bricks->width == bp->width && bricks->height == bp->height)
+		memcpy(bp->bits, bricks->bits, words * sizeof(uint64_t));
+	else
+		memset(bp->bits, 0, words * sizeof(uint64_t));
+}
+
+static void bp_fill_rect(bitplane_t *bp, int x0, int y0, int x1, int y1) {
+	x0 = x0 < 1 ? 1 : x0, x1 = x1 > bp->width - 1 ? bp->width - 1 : x1;
+	y0 = y0 < 1 ? 1 : y0, y1 = y1 > bp->height - 1 ? bp->height - 1 : y1;
+	if (x0 >= x1)
+		return;
+
+	const int b0 = x0 - 1, b1 = x1 - 1;
+	const int w0 = b0 >> 6, w1 = (b1 - 1) >> 6;
+
+	for (int y = y0; y < y1; y++) {
+		uint64_t *row = bp_row(bp, bp->bits, y);
+
+		for (int w = w0; w <= w1; w++)
+			row[w] |= bit_range(w == w0 ? b0 & 63 : 0, w == w1 ? ((b1 - 1) & 63) + 1 : 64);
+	}
+}
+
+static void bp_present(bitplane_t *bp, outbuf_t *o) {
+	const int n = bp->width - 2;
+	if (n <= 0)
+		return;
+
+	int cursor_x = -1, cursor_y = -1;
+	int reverse = -1;
+	uint64_t drawn = 0;
+
+	int y = 1;
+	for (; y < bp->height - 1; y++) {
+		const uint64_t *row = bp_row(bp, bp->bits, y);
+		uint64_t *front = bp_row(bp, bp->front, y);
+
+		if (!out_reserve_row(o, n))
+			break;
+
+		for (int w = 0; w * 64 < n; w++) {
+			const uint64_t playfield = bit_range(0, n - w * 64 < 64 ? n - w * 64 : 64);
+			uint64_t diff = (bp->stale ? ~0ULL : row[w] ^ front[w]) & playfield;
+
+			while (diff) {
+				const int b = __builtin_ctzll(diff);
+				const int on = (row[w] >> b) & 1;
+
+				const uint64_t same = diff & (on ? row[w] : ~row[w]);
+				const uint64_t rest = ~(same >> b);
+				const int len = rest ? __builtin_ctzll(rest) : 64 - b;
+
+				const int x = w * 64 + b + 1;
+				if (cursor_x != x || cursor_y != y)
+					out_move(o, x, y);
+
+				if (reverse != on) {
+					out_bytes(o, on ? "\033[7m" : reverse < 0 ? "\033[0m" : "\033[27m", on ? 4 : reverse < 0 ? 4 : 5);
+					reverse = on;
+				}
+
+				out_bytes(o, spaces, len);
+				cursor_x = x + len, cursor_y = y;
+				drawn += len;
+
+				diff &= ~bit_range(b, b + len);
+			}
+
+			front[w] = row[w];
+		}
+	}
+
+	if (reverse > 0)
+		out_bytes(o, "\033[0m", 4);
+
+	pong_count(PONG_COUNTER_CELLS, drawn);
+	bp->stale &= y < bp->height - 1;
+}
+
+
+static void paint_background(pong_ctx_t *ctx) {
+	fb_set_background(&ctx->framebuffer, ctx->background_gradient);
+
+	if (ctx->breakout_enabled)
+		bricks_paint(&ctx->bricks, &ctx->framebuffer);
+}
+
+/* layers front to back, so whatever ends up hidden is never drawn */
+static void compose_frame(pong_ctx_t *ctx) {
+	framebuffer_t *fb = &ctx->framebuffer;
+	fb_begin(fb);
+
+	if (ctx->scoreboard.enabled)
+		scoreboard_draw(ctx);
+
+	for (uint32_t i = 0; i < ctx->pool.count; i++)
+		entity_draw(ctx, &ctx->pool.entities[i]);
+
+	if (ctx->trails_enabled)
+		trails_draw(ctx);
+
+	fb_composite_background(fb, ctx->fade_enabled);
+}
+
+static void compose_monochrome(pong_ctx_t *ctx) {
+	bitplane_t *bp = &ctx->monochrome;
+	scoreboard_t *sb = &ctx->scoreboard;
+
+	bp_begin(bp, ctx->breakout_enabled ? &ctx->bricks : NULL);
+
+	if (sb->enabled) {
+		if (sb->dirty)
+			scoreboard_layout(sb, ctx->digit_spans, bp->width);
+
+		for (int i = 0; i < sb->rect_count; i++) {
+			const rect_t r = sb->rects[i];
+			bp_fill_rect(bp, r.x0, r.y0, r.x1, r.y1);
+		}
+	}
+
+	for (uint32_t i = 0; i < ctx->pool.count; i++) {
+		const entity_t *e = &ctx->pool.entities[i];
+		const int x = e->pos.x, y = e->pos.y;
+
+		for_each_span(e->spans, row, span)
+			bp_fill_rect(bp, x + span->start, y + row, x + span->start + span->len, y + row + 1);
+	}
+}
+
+
+/*
+ * rewind images: a header, then per entity its six f64s packed to the
+ * bytes that carry the value (10 for x87 extended) plus shape and hits,
+ * then the pool's handle tables and the brick field. the prediction of a
+ * tick from the one before is the tick plus one and every entity moved by
+ * its delta with no hits, so only bounces and whatever was changed from
+ * outside end up as nonzero bytes in the delta.
+ */
+#define PACKED_F64		(LDBL_MANT_DIG == 64 ? 10 : (int)sizeof(f64))
+#define PACKED_ENTITY		(6 * PACKED_F64 + 2)
+
+typedef struct {
+	uint64_t tick;
+	rng_t rng;
+	double pending_time;
+	entity_handle_t ball;
+
+	int32_t width;
+	int32_t height;
+	uint32_t count;
+	uint32_t slots_used;
+	uint32_t free_count;
+	uint32_t breakout;
+	uint32_t brick_words;
+	uint32_t brick_count;
+	uint32_t score_left;
+	uint32_t score_right;
+} rewind_header_t;
+
+static inline uint8_t *pack_f64(uint8_t *p, const f64 v) {
+	memcpy(p, &v, PACKED_F64);
+	return p + PACKED_F64;
+}
+
+static inline const uint8_t *unpack_f64(const uint8_t *p, f64 *v) {
+	*v = 0;
+	memcpy(v, p, PACKED_F64);
+	return p + PACKED_F64;
+}
+
+static inline uint8_t *pack_u32s(uint8_t *p, const uint32_t *v, const uint32_t n) {
+	memcpy(p, v, n * sizeof(uint32_t));
+	return p + n * sizeof(uint32_t);
+}
+
+static inline const uint8_t *unpack_u32s(const uint8_t *p, uint32_t *v, const uint32_t n) {
+	memcpy(v, p, n * sizeof(uint32_t));
+	return p + n * sizeof(uint32_t);
+}
+
+static rewind_header_t rewind_header(const pong_ctx_t *ctx) {
+	return (rewind_header_t){
+		.tick = ctx->tick,
+		.rng = ctx->rng,
+		.pending_time = ctx->pending_time,
+		.ball = ctx->ball,
+
+		.width = ctx->width,
+		.height = ctx->height,
+		.count = ctx->pool.count,
+		.slots_used = ctx->pool.slots_used,
+		.free_count = ctx->pool.free_count,
+		.breakout = ctx->breakout_enabled,
+		.brick_words = ctx->breakout_enabled ? (uint32_t)ctx->bricks.words * ctx->bricks.height : 0,
+		.brick_count = ctx->bricks.count,
+		.score_left = ctx->scoreboard.left,
+		.score_right = ctx->scoreboard.right,
+	};
+}
+
+static inline size_t rewind_image_size(const rewind_header_t *h) {
+	return sizeof(*h) + (size_t)h->count * (PACKED_ENTITY + sizeof(uint32_t))
+		+ (size_t)h->slots_used * 2 * sizeof(uint32_t) + (size_t)h->free_count * sizeof(uint32_t)
+		+ (size_t)h->brick_words * sizeof(uint64_t);
+}
+
+/* images are xored and scanned a word at a time, so buffers are padded to one with zeros */
+static inline size_t rewind_padded(const size_t size) {
+	return (size + 7) & ~(size_t)7;
+}
+
+static bool rewind_reserve(rewind_t *r, const size_t size) {
+	const size_t padded = rewind_padded(size);
+	if (padded <= r->image_cap)
+		return true;
+
+	/* a literal costs at most two varints on top of its bytes, and literals are at least 8 apart */
+	if (!grow(r->image, padded) || !grow(r->scratch, padded) || !grow(r->packed, padded * 2 + 16))
+		return false;
+
+	r->image_cap = padded;
+	return true;
+}
+
+static void rewind_pack(const pong_ctx_t *ctx, const rewind_header_t *h, uint8_t *image) {
+	const entity_pool_t *pool = &ctx->pool;
+
+	memcpy(image, h, sizeof(*h));
+	uint8_t *p = image + sizeof(*h);
+
+	for (uint32_t i = 0; i < h->count; i++) {
+		const entity_t *e = &pool->entities[i];
+
+		p = pack_f64(p, e->pos.x), p = pack_f64(p, e->pos.y);
+		p = pack_f64(p, e->delta.x), p = pack_f64(p, e->delta.y);
+		p = pack_f64(p, e->size.x), p = pack_f64(p, e->size.y);
+		*p++ = e->shape;
+		*p++ = e->hits;
+	}
+
+	p = pack_u32s(p, pool->owner, h->count);
+	p = pack_u32s(p, pool->dense, h->slots_used);
+	p = pack_u32s(p, pool->generation, h->slots_used);
+	p = pack_u32s(p, pool->free, h->free_count);
+
+	/* no bricks without breakout, and no array to copy from either */
+	if (h->brick_words)
+		memcpy(p, ctx->bricks.bits, h->brick_words * sizeof(uint64_t));
+	p += h->brick_words * sizeof(uint64_t);
+
+	memset(p, 0, rewind_padded(p - image) - (p - image));
+}
+
+/* everything up to the bricks, which are left to the caller at p */
+static const uint8_t *rewind_unpack_pool(pong_ctx_t *ctx, const uint8_t *image, rewind_header_t *header) {
+	entity_pool_t *pool = &ctx->pool;
+
+	rewind_header_t h;
+	memcpy(&h, image, sizeof(h));
+	const uint8_t *p = image + sizeof(h);
+
+	ctx->tick = h.tick;
+	ctx->rng = h.rng;
+	ctx->pending_time = h.pending_time;
+	ctx->ball = h.ball;
+
+	pool->count = h.count;
+	pool->slots_used = h.slots_used;
+	pool->free_count = h.free_count;
+
+	for (uint32_t i = 0; i < h.count; i++) {
+		entity_t *e = &pool->entities[i];
+
+		p = unpack_f64(p, &e->pos.x), p = unpack_f64(p, &e->pos.y);
+		p = unpack_f64(p, &e->delta.x), p = unpack_f64(p, &e->delta.y);
+		p = unpack_f64(p, &e->size.x), p = unpack_f64(p, &e->size.y);
+		e->shape = *p++;
+		e->hits = *p++;
+
+		/* every entity's table is cached from when it had this shape, it's only looked up */
+		e->spans = span_table_get(ctx, e->shape, e->size);
+	}
+
+	p = unpack_u32s(p, pool->owner, h.count);
+	p = unpack_u32s(p, pool->dense, h.slots_used);
+	p = unpack_u32s(p, pool->generation, h.slots_used);
+	p = unpack_u32s(p, pool->free, h.free_count);
+
+	ctx->scoreboard.left = h.score_left;
+	ctx->scoreboard.right = h.score_right;
+	ctx->scoreboard.dirty = true;
+
+	*header = h;
+	return p;
+}
+
+static void rewind_unpack(pong_ctx_t *ctx, const uint8_t *image) {
+	entity_pool_t *pool = &ctx->pool;
+
+	rewind_header_t h;
+	const uint8_t *p = rewind_unpack_pool(ctx, image, &h);
+
+	/* bricks only fit a field of the size they were recorded at */
+	const bool same_size = h.width == ctx->width && h.height == ctx->height;
+	ctx->breakout_enabled = h.breakout;
+	if (h.breakout) {
+		bricks_build(&ctx->bricks, ctx->width, ctx->height);
+		if (same_size && h.brick_words) {
+			memcpy(ctx->bricks.bits, p, h.brick_words * sizeof(uint64_t));
+			ctx->bricks.count = h.brick_count;
+		}
+	}
+
+	if (!same_size) {
+		for (uint32_t i = 0; i < pool->count; i++)
+			entity_fit(ctx, &pool->entities[i]);
+	}
+
+	trails_clear(&ctx->trails);
+	paint_background(ctx);
+}
+
+/* the next tick as it would be if nothing bounced and nothing changed from outside */
+static void rewind_predict(uint8_t *image) {
+	rewind_header_t h;
+	memcpy(&h, image, sizeof(h));
+	h.tick++;
+	memcpy(image, &h, sizeof(h));
+
+	uint8_t *p = image + sizeof(h);
+	for (uint32_t i = 0; i < h.count; i++, p += PACKED_ENTITY) {
+		f64 pos_x, pos_y, delta_x, delta_y;
+		unpack_f64(unpack_f64(unpack_f64(unpack_f64(p, &pos_x), &pos_y), &delta_x), &delta_y);
+
+		const vec2 pos = vec2_add((vec2){ pos_x, pos_y }, (vec2){ delta_x, delta_y });
+		pack_f64(pack_f64(p, pos.x), pos.y);
+		p[PACKED_ENTITY - 1] = 0;
+	}
+}
+
+/*
+ * keyframes have nothing to predict from but the entity before, whose size,
+ * shape and often speed are the same, so each record is xored with the one
+ * before it. undone front to back.
+ */
+static void rewind_key_xor(uint8_t *image, const bool undo) {
+	rewind_header_t h;
+	memcpy(&h, image, sizeof(h));
+
+	uint8_t *entities = image + sizeof(h);
+	const size_t n = (size_t)h.count * PACKED_ENTITY;
+
+	if (undo) {
+		for (size_t i = PACKED_ENTITY; i < n; i++)
+			entities[i] ^= entities[i - PACKED_ENTITY];
+	} else {
+		for (size_t i = n; i-- > PACKED_ENTITY;)
+			entities[i] ^= entities[i - PACKED_ENTITY];
+	}
+}
+
+static inline uint8_t *varint_put(uint8_t *p, uint64_t v) {
+	for (; v >= 0x80; v >>= 7)
+		*p++ = v | 0x80;
+	*p++ = v;
+	return p;
+}
+
+static inline const uint8_t *varint_get(const uint8_t *p, uint64_t *v) {
+	*v = 0;
+	for (int shift = 0;; shift += 7) {
+		*v |= (uint64_t)(*p & 0x7F) << shift;
+		if (!(*p++ & 0x80))
+			return p;
+	}
+}
+
+/*
+ * (zero run, literal length, literal) triples over whole words. a literal
+ * only ends at a run of at least two zero words, so it's never worth
+ * splitting for less.
+ */
+static size_t rewind_encode(const uint8_t *image, const size_t size, uint8_t *out) {
+	const uint64_t *w = (const uint64_t *)image;
+	const size_t words = rewind_padded(size) / 8;
+	uint8_t *p = out;
+
+	for (size_t i = 0; i < words;) {
+		const size_t zeros_from = i;
+		while (i < words && !w[i])
+			i++;
+
+		const size_t literal_from = i;
+		while (i < words && (w[i] || (i + 1 < words && w[i + 1])))
+			i++;
+
+		p = varint_put(p, literal_from - zeros_from);
+		p = varint_put(p, i - literal_from);
+		memcpy(p, w + literal_from, (i - literal_from) * 8);
+		p += (i - literal_from) * 8;
+	}
+
+	return p - out;
+}
+
+/* xors an encoded delta into image */
+static void rewind_apply(uint8_t *image, const uint8_t *in, const size_t len) {
+	uint64_t *w = (uint64_t *)image;
+	const uint8_t *end = in + len;
+
+	for (size_t i = 0; in < end;) {
+		uint64_t zeros, literal;
+		in = varint_get(varint_get(in, &zeros), &literal);
+		i += zeros;
+
+		for (uint64_t j = 0; j < literal; j++, i++, in += 8) {
+			uint64_t v;
+			memcpy(&v, in, 8);
+			w[i] ^= v;
+		}
+	}
+}
+
+static inline rewind_entry_t *rewind_entry(const rewind_t *r, const uint32_t i) {
+	return &r->entries[i % REWIND_ENTRIES];
+}
+
+/* drops the oldest keyframe and the deltas that need it */
+static void rewind_drop_oldest(rewind_t *r) {
+	do
+		r->tail++;
+	while (r->tail != r->head && !rewind_entry(r, r->tail)->keyframe);
+}
+
+static void rewind_clear(rewind_t *r) {
+	r->head = r->tail = 0;
+	r->data_head = 0;
+	r->image_size = 0;
+}
+
+/*
+ * false, with nothing stored, if making room took the delta's keyframe with
+ * it. a group bigger than the ring gets there, the caller stores a keyframe
+ * instead.
+ */
+static bool rewind_store(rewind_t *r, const uint64_t tick, const size_t len, const bool keyframe) {
+	if (len > REWIND_BYTES) {
+		rewind_clear(r);
+		return true;
+	}
+
+	/* entries never wrap around the end of the ring, they start over at 0 */
+	uint64_t at = r->data_head;
+	if (at % REWIND_BYTES + len > REWIND_BYTES)
+		at += REWIND_BYTES - at % REWIND_BYTES;
+
+	while (r->tail != r->head && (r->head - r->tail == REWIND_ENTRIES
+			|| at + len - rewind_entry(r, r->tail)->offset > REWIND_BYTES))
+		rewind_drop_oldest(r);
+
+	if (!keyframe && r->tail == r->head)
+		return false;
+
+	memcpy(r->data + at % REWIND_BYTES, r->packed, len);
+	*rewind_entry(r, r->head++) = (rewind_entry_t){ tick, at, len, r->image_size, keyframe };
+	r->data_head = at + len;
+
+	return true;
+}
+
+static void rewind_record(pong_ctx_t *ctx) {
+	rewind_t *r = &ctx->rewind;
+
+	const rewind_header_t h = rewind_header(ctx);
+	const size_t size = rewind_image_size(&h);
+
+	/* the next tick that fits starts the history over with a keyframe */
+	if (!rewind_reserve(r, size)) {
+		rewind_clear(r);
+		return;
+	}
+	rewind_pack(ctx, &h, r->scratch);
+
+	/* a delta needs the tick before, in the same layout, and keyframes often enough to bound a seek */
+	rewind_header_t last;
+	const bool follows = r->head != r->tail && r->image_size == size
+		&& rewind_entry(r, r->head - 1)->tick + 1 == h.tick;
+	if (follows)
+		memcpy(&last, r->image, sizeof(last));
+
+	uint32_t since = 0;
+	while (follows && since < r->head - r->tail && !rewind_entry(r, r->head - 1 - since)->keyframe)
+		since++;
+
+	const bool keyframe = !follows || since + 1 >= REWIND_KEYFRAME
+		|| last.count != h.count || last.slots_used != h.slots_used
+		|| last.free_count != h.free_count || last.brick_words != h.brick_words;
+
+	size_t len;
+	if (keyframe) {
+		rewind_key_xor(r->scratch, false);
+		len = rewind_encode(r->scratch, size, r->packed);
+		rewind_key_xor(r->scratch, true);
+	} else {
+		rewind_predict(r->image);
+
+		uint64_t *a = (uint64_t *)r->image;
+		const uint64_t *b = (const uint64_t *)r->scratch;
+		for (size_t i = 0; i < rewind_padded(size) / 8; i++)
+			a[i] ^= b[i];
+
+		len = rewind_encode(r->image, size, r->packed);
+	}
+
+	uint8_t *swap = r->image;
+	r->image = r->scratch;
+	r->scratch = swap;
+	r->image_size = size;
+
+	if (rewind_store(r, h.tick, len, keyframe))
+		return;
+
+	rewind_key_xor(r->image, false);
+	len = rewind_encode(r->image, size, r->packed);
+	rewind_key_xor(r->image, true);
+
+	rewind_store(r, h.tick, len, true);
+}
+
+/* forgets the newest tick, image is the state of the one before it */
+static void rewind_unrecord(rewind_t *r, const uint8_t *image, const size_t size) {
+	if (r->head != r->tail)
+		r->data_head = rewind_entry(r, --r->head)->offset;
+
+	if (!rewind_reserve(r, size)) {
+		rewind_clear(r);
+		return;
+	}
+	memcpy(r->image, image, rewind_padded(size));
+	r->image_size = size;
+}
+
+int pong_set_rewind(pong_ctx_t *ctx, const bool enabled) {
+	rewind_t *r = &ctx->rewind;
+
+	if (enabled && !r->entries && (!grow(r->data, REWIND_BYTES)
+			|| !grow(r->entries, REWIND_ENTRIES * sizeof(rewind_entry_t))))
+		return -1;
+
+	rewind_clear(r);
+	r->enabled = enabled;
+
+	return 0;
+}
+
+bool pong_seek(pong_ctx_t *ctx, const uint64_t tick) {
+	rewind_t *r = &ctx->rewind;
+	if (r->head == r->tail)
+		return false;
+
+	const uint64_t first = rewind_entry(r, r->tail)->tick;
+	if (tick < first || tick - first >= r->head - r->tail)
+		return false;
+
+	/* ticks are recorded back to back, so the entry is found by counting */
+	const uint32_t target = r->tail + (tick - first);
+	uint32_t k = target;
+	while (k != r->tail && !rewind_entry(r, k)->keyframe)
+		k--;
+	if (!rewind_entry(r, k)->keyframe)
+		return false;
+
+	for (uint32_t i = k; i <= target; i++) {
+		const rewind_entry_t *e = rewind_entry(r, i);
+
+		if (e->keyframe)
+			memset(r->image, 0, rewind_padded(e->image_size));
+		else
+			rewind_predict(r->image);
+
+		rewind_apply(r->image, r->data + e->offset % REWIND_BYTES, e->len);
+		if (e->keyframe)
+			rewind_key_xor(r->image, true);
+		r->image_size = e->image_size;
+	}
+
+	r->head = target + 1;
+	r->data_head = rewind_entry(r, target)->offset + rewind_entry(r, target)->len;
+
+	rewind_unpack(ctx, r->image);
+	return true;
+}
+
+bool pong_rewind(pong_ctx_t *ctx) {
+	return ctx->tick > 0 && pong_seek(ctx, ctx->tick - 1);
+}
+
+
+pong_ctx_t *pong_new(const int width, const int height, const uint64_t seed) {
+	pong_ctx_t *ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return NULL;
+
+	pong_counters_init();
+
+	ctx->tick_rate = PONG_DEFAULT_FPS;
+	ctx->rng = rng_new(seed);
+
+	trails_init(ctx);
+	aa_init(ctx);
+
+	if (!digits_init(ctx) || pong_resize(ctx, width, height)) {
+		pong_free(ctx);
+		return NULL;
+	}
+
+	ctx->ball = pong_add_entity(ctx, DEFAULT_ENTITY_PROPERTIES);
+	if (!pong_get_entity(ctx, ctx->ball)) {
+		pong_free(ctx);
+		return NULL;
+	}
+
+	return ctx;
+}
+
+void pong_free(pong_ctx_t *ctx) {
+	if (!ctx)
+		return;
+
+	fb_free(&ctx->framebuffer);
+	free(ctx->monochrome.bits);
+	free(ctx->monochrome.front);
+	free(ctx->bricks.bits);
+
+	span_cache_free(ctx);
+	for (int d = 0; d < 10; d++) {
+		free(ctx->digit_spans[d].rows);
+		free(ctx->digit_spans[d].spans);
+	}
+
+	free(ctx->aa_coverage);
+	free(ctx->output.data);
+
+	free(ctx->rewind.data);
+	free(ctx->rewind.entries);
+	free(ctx->rewind.image);
+	free(ctx->rewind.scratch);
+	free(ctx->rewind.packed);
+
+	free(ctx->speculation.image);
+	free(ctx->speculation.front);
+	free(ctx->speculation.mono_front);
+
+	free(ctx);
+}
+
+int pong_resize(pong_ctx_t *ctx, const int width, const int height) {
+	framebuffer_t *fb = &ctx->framebuffer;
+	bitplane_t *bp = &ctx->monochrome;
+
+	/* shrinking back to the old size can't fail, it's all within capacity */
+	if (!fb_resize(fb, width, height))
+		return -1;
+	if (!bp_resize(bp, width, height)) {
+		fb_resize(fb, ctx->width, ctx->height);
+		return -1;
+	}
+	if (ctx->breakout_enabled && !bricks_resize(&ctx->bricks, width, height)) {
+		fb_resize(fb, ctx->width, ctx->height);
+		bp_resize(bp, ctx->width, ctx->height);
+		return -1;
+	}
+
+	ctx->width = width;
+	ctx->height = height;
+
+	for (uint32_t i = 0; i < ctx->pool.count; i++)
+		entity_fit(ctx, &ctx->pool.entities[i]);
+
+	paint_background(ctx);
+	ctx->scoreboard.dirty = true;
+
+	return 0;
+}
+
+void pong_tick(pong_ctx_t *ctx) {
+	if (ctx->paused)
+		return;
+
+	const uint64_t start = pong_timer_start();
+
+	if (ctx->trails_enabled)
+		trails_step(&ctx->trails, &ctx->pool);
+
+	uint64_t collisions = 0;
+	for (uint32_t i = 0; i < ctx->pool.count; i++)
+		collisions += entity_update(ctx, &ctx->pool.entities[i]);
+	pong_count(PONG_COUNTER_COLLISIONS, collisions);
+
+	const entity_t *ball = pong_get_entity(ctx, ctx->ball);
+	if (ball && ctx->scoreboard.enabled)
+		scoreboard_score(&ctx->scoreboard, ball->hits);
+
+	ctx->tick++;
+	if (ctx->rewind.enabled)
+		rewind_record(ctx);
+
+	pong_timer_stop(PONG_TIMER_TICK, start);
+}
+
+/* fixed steps at the tick rate, the remainder carries over to the next call */
+uint32_t pong_step(pong_ctx_t *ctx, const double dt) {
+	const double step = 1.0 / ctx->tick_rate;
+	uint32_t ticks = 0;
+
+	for (ctx->pending_time += dt; ctx->pending_time >= step; ctx->pending_time -= step) {
+		pong_tick(ctx);
+		ticks++;
+	}
+
+	return ticks;
+}
+
+size_t pong_render_pending(const pong_ctx_t *ctx) {
+	return ctx->output.len - ctx->output_sent;
+}
+
+void pong_compose(pong_ctx_t *ctx) {
+	const uint64_t start = pong_timer_start();
+
+	if (ctx->monochrome_enabled)
+		compose_monochrome(ctx);
+	else
+		compose_frame(ctx);
+
+	pong_timer_stop(PONG_TIMER_COMPOSE, start);
+}
+
+size_t pong_encode(pong_ctx_t *ctx) {
+	outbuf_t *o = &ctx->output;
+	const uint64_t start = pong_timer_start();
+
+	o->len = 0;
+	ctx->output_sent = 0;
+
+	if (ctx->monochrome_enabled)
+		bp_present(&ctx->monochrome, o);
+	else
+		fb_present(&ctx->framebuffer, ctx->run_cache, o);
+
+	o->written += o->len;
+	o->last_frame = o->len;
+
+	pong_count(PONG_COUNTER_BYTES, o->len);
+	pong_timer_stop(PONG_TIMER_ENCODE, start);
+
+	return o->len;
+}
+
+size_t pong_render(pong_ctx_t *ctx, char *buf, const size_t cap) {
+	outbuf_t *o = &ctx->output;
+
+	/* a committed speculative frame is already encoded, even if it came to nothing */
+	if (!pong_render_pending(ctx) && !ctx->speculation.committed) {
+		pong_compose(ctx);
+		pong_encode(ctx);
+	}
+	ctx->speculation.committed = false;
+
+	const size_t pending = pong_render_pending(ctx);
+	const size_t n = pending < cap ? pending : cap;
+	if (n == 0)
+		return 0;
+
+	memcpy(buf, o->data + ctx->output_sent, n);
+	ctx->output_sent += n;
+
+	return n;
+}
+
+
+
+/*
+ * speculation. the tick is recorded for rewinding like any other and taken
+ * back out on discard. trails are put back by undoing a tick's ageing,
+ * unless its new cells ran over old ones, which are lost and take the rest
+ * of the trails with them.
+ */
+static void trails_unwind(trail_pool_t *t, const uint32_t head, const uint32_t tail) {
+	if (t->head - tail > TRAIL_CAPACITY) {
+		t->head = t->tail = head;
+		return;
+	}
+
+	for (uint32_t n = tail; n != head; n++)
+		t->age[n & TRAIL_MASK]--;
+
+	t->head = head;
+	t->tail = tail;
+}
+
+bool pong_speculate(pong_ctx_t *ctx) {
+	speculation_t *s = &ctx->speculation;
+	const framebuffer_t *fb = &ctx->framebuffer;
+	const bitplane_t *bp = &ctx->monochrome;
+
+	const rewind_header_t h = rewind_header(ctx);
+	const size_t size = rewind_image_size(&h);
+	if (rewind_padded(size) > s->image_cap) {
+		if (!grow(s->image, rewind_padded(size)))
+			return false;
+		s->image_cap = rewind_padded(size);
+	}
+
+	/* only the renderer in use has a screen to put back */
+	const size_t words = (size_t)bp->words * bp->height;
+	const size_t cells = (size_t)fb->width * fb->height;
+	if (ctx->monochrome_enabled && words > s->mono_front_cap) {
+		if (!grow(s->mono_front, words * sizeof(uint64_t)))
+			return false;
+		s->mono_front_cap = words;
+	} else if (!ctx->monochrome_enabled && cells > s->front_cap) {
+		if (!grow(s->front, cells * sizeof(rgb)))
+			return false;
+		s->front_cap = cells;
+	}
+
+	s->image_size = size;
+	rewind_pack(ctx, &h, s->image);
+
+	if (ctx->monochrome_enabled) {
+		memcpy(s->mono_front, bp->front, words * sizeof(uint64_t));
+		s->mono_stale = bp->stale;
+	} else {
+		memcpy(s->front, fb->front, cells * sizeof(rgb));
+		s->stale = fb->stale;
+	}
+
+	s->trail_head = ctx->trails.head;
+	s->trail_tail = ctx->trails.tail;
+	s->last_frame = ctx->output.last_frame;
+	s->ticked = !ctx->paused;
+	pong_counters_mark(&s->counters);
+
+	pong_tick(ctx);
+	pong_compose(ctx);
+	pong_encode(ctx);
+
+	s->active = true;
+	return true;
+}
+
+void pong_speculate_commit(pong_ctx_t *ctx) {
+	speculation_t *s = &ctx->speculation;
+	if (!s->active)
+		return;
+
+	s->active = false;
+	s->committed = true;
+}
+
+void pong_speculate_discard(pong_ctx_t *ctx) {
+	speculation_t *s = &ctx->speculation;
+	if (!s->active)
+		return;
+
+	s->active = false;
+
+	if (s->ticked) {
+		rewind_header_t h;
+		const uint8_t *bricks = rewind_unpack_pool(ctx, s->image, &h);
+
+		/* broken bricks took their cells out of the background too */
+		if (h.brick_count != ctx->bricks.count) {
+			memcpy(ctx->bricks.bits, bricks, h.brick_words * sizeof(uint64_t));
+			ctx->bricks.count = h.brick_count;
+			paint_background(ctx);
+		}
+
+		if (ctx->trails_enabled)
+			trails_unwind(&ctx->trails, s->trail_head, s->trail_tail);
+		if (ctx->rewind.enabled)
+			rewind_unrecord(&ctx->rewind, s->image, s->image_size);
+	}
+
+	if (ctx->monochrome_enabled) {
+		bitplane_t *bp = &ctx->monochrome;
+		memcpy(bp->front, s->mono_front, (size_t)bp->words * bp->height * sizeof(uint64_t));
+		bp->stale = s->mono_stale;
+	} else {
+		framebuffer_t *fb = &ctx->framebuffer;
+		memcpy(fb->front, s->front, (size_t)fb->width * fb->height * sizeof(rgb));
+		fb->stale = s->stale;
+	}
+
+	outbuf_t *o = &ctx->output;
+	o->written -= o->len;
+	o->last_frame = s->last_frame;
+	o->len = 0;
+	ctx->output_sent = 0;
+
+	/* the frame gets done over, it shouldn't count twice */
+	pong_counters_restore(&s->counters);
+}
+
+
+void pong_set_trails(pong_ctx_t *ctx, const bool enabled) {
+	ctx->trails_enabled = enabled;
+	trails_clear(&ctx->trails);
+}
+
+void pong_set_gradient(pong_ctx_t *ctx, const bool enabled) {
+	ctx->background_gradient = enabled;
+	paint_background(ctx);
+}
+
+void pong_set_fade(pong_ctx_t *ctx, const bool enabled) {
+	ctx->fade_enabled = enabled;
+}
+
+void pong_set_antialiasing(pong_ctx_t *ctx, const bool enabled) {
+	ctx->antialiasing = enabled;
+}
+
+int pong_set_breakout(pong_ctx_t *ctx, const bool enabled) {
+	if (enabled && !bricks_build(&ctx->bricks, ctx->width, ctx->height))
+		return -1;
+
+	ctx->breakout_enabled = enabled;
+	paint_background(ctx);
+
+	return 0;
+}
+
+void pong_set_scoreboard(pong_ctx_t *ctx, const bool enabled) {
+	ctx->scoreboard = (scoreboard_t){ .enabled = enabled, .dirty = true };
+}
+
+void pong_set_monochrome(pong_ctx_t *ctx, const bool enabled) {
+	ctx->monochrome_enabled = enabled;
+	ctx->monochrome.stale = true;
+	ctx->framebuffer.stale = true;
+}
+
+
+static bool entity_grow(pong_ctx_t *ctx, entity_t *e) {
+	if (e->size.x < MAX_ENTITY_WIDTH(ctx) && e->size.y < MAX_ENTITY_HEIGHT(ctx))
+		return entity_reshape(ctx, e, e->shape, vec2_add(e->size, (vec2){ 1, 1 }));
+
+	return true;
+}
+
+static bool entity_shrink(pong_ctx_t *ctx, entity_t *e) {
+	if (e->size.x > MIN_ENTITY_WIDTH && e->size.y > MIN_ENTITY_HEIGHT)
+		return entity_reshape(ctx, e, e->shape, vec2_sub(e->size, (vec2){ 1, 1 }));
+
+	return true;
+}
+
+static bool entity_next_shape(pong_ctx_t *ctx, entity_t *e) {
+	return entity_reshape(ctx, e, (e->shape + 1) % SHAPE_COUNT, e->size);
+}
+
+static bool entity_speed_up(pong_ctx_t *ctx, entity_t *e) {
+	if (e->delta.x < MAX_ENTITY_DELTA_X(ctx) && e->delta.y < MAX_ENTITY_DELTA_Y(ctx)) {
+		e->delta.x = (!e->delta.x + e->delta.x) * 2;
+		e->delta.y = (!e->delta.y + e->delta.y) * 2;
+	}
+
+	return true;
+}
+
+static bool entity_slow_down(pong_ctx_t *ctx, entity_t *e) {
+	(void)ctx;
+
+	if (e->delta.x > MIN_ENTITY_DELTA_X && e->delta.y > MIN_ENTITY_DELTA_Y) {
+		e->delta.x /= 2;
+		e->delta.y /= 2;
+	}
+
+	return true;
+}
+
+static bool entity_set_size(pong_ctx_t *ctx, entity_t *e, const vec2 size) {
+	const vec2 clamped = {
+		size.x < MIN_ENTITY_WIDTH ? MIN_ENTITY_WIDTH : size.x > MAX_ENTITY_WIDTH(ctx) ? MAX_ENTITY_WIDTH(ctx) : size.x,
+		size.y < MIN_ENTITY_HEIGHT ? MIN_ENTITY_HEIGHT : size.y > MAX_ENTITY_HEIGHT(ctx) ? MAX_ENTITY_HEIGHT(ctx) : size.y,
+	};
+
+	return entity_reshape(ctx, e, e->shape, (vec2){ floorl(clamped.x), floorl(clamped.y) });
+}
+
+/* every entity is tried, -1 if any of them couldn't be changed */
+static inline int entity_pool_each(pong_ctx_t *ctx, bool (*f)(pong_ctx_t *, entity_t *)) {
+	bool ok = true;
+	for (uint32_t i = 0; i < ctx->pool.count; i++)
+		ok &= f(ctx, &ctx->pool.entities[i]);
+
+	return ok ? 0 : -1;
+}
+
+int pong_grow(pong_ctx_t *ctx) {
+	return entity_pool_each(ctx, entity_grow);
+}
+
+int pong_shrink(pong_ctx_t *ctx) {
+	return entity_pool_each(ctx, entity_shrink);
+}
+
+int pong_next_shape(pong_ctx_t *ctx) {
+	return entity_pool_each(ctx, entity_next_shape);
+}
+
+int pong_speed_up(pong_ctx_t *ctx) {
+	return entity_pool_each(ctx, entity_speed_up);
+}
+
+int pong_slow_down(pong_ctx_t *ctx) {
+	return entity_pool_each(ctx, entity_slow_down);
+}
+
+
+bool pong_command_parse(const char *line, pong_command_t *cmd) {
+	char op[16];
+	double a = 0, b = 0;
+
+	const int n = sscanf(line, "%15s %lf %lf", op, &a, &b);
+	if (n < 1)
+		return false;
+
+	static const struct {
+		const char *name;
+		pong_op_t op;
+		int args;
+	} ops[] = {
+		{ "size", PONG_SIZE, 2 },
+		{ "delta", PONG_DELTA, 2 },
+		{ "spawn", PONG_SPAWN, 1 },
+		{ "despawn", PONG_DESPAWN, 1 },
+		{ "fps", PONG_FPS, 1 },
+		{ "pause", PONG_PAUSE, 0 },
+		{ "resume", PONG_RESUME, 0 },
+	};
+
+	for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+		if (strcmp(op, ops[i].name))
+			continue;
+
+		/* %lf takes nan and inf, nothing downstream expects either */
+		if (n - 1 < ops[i].args || !isfinite(a) || !isfinite(b))
+			return false;
+
+		*cmd = (pong_command_t){ ops[i].op, a, b };
+		return true;
+	}
+
+	return false;
+}
+
+int pong_command(pong_ctx_t *ctx, const pong_command_t *cmd) {
+	entity_pool_t *pool = &ctx->pool;
+
+	switch (cmd->op) {
+	case PONG_SIZE: {
+		bool ok = true;
+		for (uint32_t i = 0; i < pool->count; i++)
+			ok &= entity_set_size(ctx, &pool->entities[i], (vec2){ cmd->a, cmd->b });
+
+		if (!ok)
+			return -1;
+	} break;
+
+	case PONG_DELTA: {
+		for (uint32_t i = 0; i < pool->count; i++)
+			pool->entities[i].delta = (vec2){ cmd->a, cmd->b };
+	} break;
+
+	/* counts past the pool are clamped before they become a uint32_t */
+	case PONG_SPAWN: pong_spawn(ctx, cmd->a > 0 ? fmin(cmd->a, MAX_ENTITIES) : 0); break;
+	case PONG_DESPAWN: pong_despawn(ctx, cmd->a > 0 ? fmin(cmd->a, MAX_ENTITIES) : 0); break;
+
+	case PONG_FPS: {
+		ctx->tick_rate = cmd->a < PONG_MIN_FPS ? PONG_MIN_FPS : cmd->a > PONG_MAX_FPS ? PONG_MAX_FPS : cmd->a;
+	} break;
+
+	case PONG_PAUSE: ctx->paused = true; break;
+	case PONG_RESUME: ctx->paused = false; break;
+
+	default: return errno = EINVAL, -1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * snapshots: a header followed by the live parts of the entity pool, the
+ * trail ring and the brick field, each at a 64 byte aligned offset the
+ * header records. entities are stored in entity_t's layout, written field
+ * by field so the padding and the span pointer stay zero, so the sizes of
+ * entity_t and f64 are checked on restore and a snapshot only moves
+ * between builds that agree on them.
+ * the framebuffer and the caches aren't saved, they're rebuilt from the
+ * rest.
+ */
+#define SNAPSHOT_MAGIC		0x70616E73
+#define SNAPSHOT_VERSION	1
+#define SNAPSHOT_ALIGN		64
+
+enum {
+	SNAPSHOT_PAUSED		= 1 << 0,
+	SNAPSHOT_TRAILS		= 1 << 1,
+	SNAPSHOT_GRADIENT	= 1 << 2,
+	SNAPSHOT_FADE		= 1 << 3,
+	SNAPSHOT_ANTIALIASING	= 1 << 4,
+	SNAPSHOT_BREAKOUT	= 1 << 5,
+	SNAPSHOT_MONOCHROME	= 1 << 6,
+	SNAPSHOT_SCOREBOARD	= 1 << 7,
+};
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entity_size;
+	uint32_t f64_size;
+
+	uint64_t size;
+	uint64_t tick;
+	double pending_time;
+	rng_t rng;
+
+	int32_t width;
+	int32_t height;
+	int32_t tick_rate;
+	uint32_t flags;
+
+	entity_handle_t ball;
+	uint32_t count;
+	uint32_t slots_used;
+	uint32_t free_count;
+
+	uint32_t trail_count;
+	uint32_t brick_words;
+	uint32_t brick_count;
+	uint32_t score_left;
+	uint32_t score_right;
+
+	uint64_t entities;
+	uint64_t owner;
+	uint64_t dense;
+	uint64_t generation;
+	uint64_t free;
+	uint64_t trail_x;
+	uint64_t trail_y;
+	uint64_t trail_age;
+	uint64_t bricks;
+} snapshot_header_t;
+
+static inline uint64_t snapshot_section(uint64_t *end, const uint64_t bytes) {
+	const uint64_t at = (*end + SNAPSHOT_ALIGN - 1) & ~(uint64_t)(SNAPSHOT_ALIGN - 1);
+	*end = at + bytes;
+	return at;
+}
+
+/* everything but the offsets comes from the counts, so save and restore lay it out the same way */
+static void snapshot_layout(snapshot_header_t *h) {
+	uint64_t end = sizeof(snapshot_header_t);
+
+	h->entities = snapshot_section(&end, (uint64_t)h->count * sizeof(entity_t));
+	h->owner = snapshot_section(&end, (uint64_t)h->count * sizeof(uint32_t));
+	h->dense = snapshot_section(&end, (uint64_t)h->slots_used * sizeof(uint32_t));
+	h->generation = snapshot_section(&end, (uint64_t)h->slots_used * sizeof(uint32_t));
+	h->free = snapshot_section(&end, (uint64_t)h->free_count * sizeof(uint32_t));
+	h->trail_x = snapshot_section(&end, (uint64_t)h->trail_count * sizeof(int16_t));
+	h->trail_y = snapshot_section(&end, (uint64_t)h->trail_count * sizeof(int16_t));
+	h->trail_age = snapshot_section(&end, (uint64_t)h->trail_count * sizeof(uint8_t));
+	h->bricks = snapshot_section(&end, (uint64_t)h->brick_words * sizeof(uint64_t));
+	h->size = end;
+}
+
+static snapshot_header_t snapshot_header(const pong_ctx_t *ctx) {
+	const entity_pool_t *pool = &ctx->pool;
+
+	snapshot_header_t h = {
+		.magic = SNAPSHOT_MAGIC,
+		.version = SNAPSHOT_VERSION,
+		.entity_size = sizeof(entity_t),
+		.f64_size = sizeof(f64),
+
+		.tick = ctx->tick,
+		.pending_time = ctx->pending_time,
+		.rng = ctx->rng,
+
+		.width = ctx->width,
+		.height = ctx->height,
+		.tick_rate = ctx->tick_rate,
+		.flags = (ctx->paused ? SNAPSHOT_PAUSED : 0)
+			| (ctx->trails_enabled ? SNAPSHOT_TRAILS : 0)
+			| (ctx->background_gradient ? SNAPSHOT_GRADIENT : 0)
+			| (ctx->fade_enabled ? SNAPSHOT_FADE : 0)
+			| (ctx->antialiasing ? SNAPSHOT_ANTIALIASING : 0)
+			| (ctx->breakout_enabled ? SNAPSHOT_BREAKOUT : 0)
+			| (ctx->monochrome_enabled ? SNAPSHOT_MONOCHROME : 0)
+			| (ctx->scoreboard.enabled ? SNAPSHOT_SCOREBOARD : 0),
+
+		.ball = ctx->ball,
+		.count = pool->count,
+		.slots_used = pool->slots_used,
+		.free_count = pool->free_count,
+
+		.trail_count = ctx->trails.head - ctx->trails.tail,
+		.brick_words = ctx->breakout_enabled ? (uint32_t)ctx->bricks.words * ctx->bricks.height : 0,
+		.brick_count = ctx->bricks.count,
+		.score_left = ctx->scoreboard.left,
+		.score_right = ctx->scoreboard.right,
+	};
+
+	snapshot_layout(&h);
+	return h;
+}
+
+/*
+ * into the zeroed file one field at a time: copying whole entities would
+ * take along whatever is in the padding and in the bytes of each long
+ * double that don't hold the value
+ */
+static void snapshot_put_entity(entity_t *to, const entity_t *e) {
+	to->pos.x = e->pos.x, to->pos.y = e->pos.y;
+	to->delta.x = e->delta.x, to->delta.y = e->delta.y;
+	to->size.x = e->size.x, to->size.y = e->size.y;
+	to->shape = e->shape;
+	to->hits = e->hits;
+}
+
+static void snapshot_fill(const pong_ctx_t *ctx, const snapshot_header_t *h, char *base) {
+	const entity_pool_t *pool = &ctx->pool;
+	const trail_pool_t *t = &ctx->trails;
+
+	memcpy(base, h, sizeof(*h));
+
+	entity_t *entities = (entity_t *)(base + h->entities);
+	for (uint32_t i = 0; i < h->count; i++)
+		snapshot_put_entity(&entities[i], &pool->entities[i]);
+
+	memcpy(base + h->owner, pool->owner, h->count * sizeof(uint32_t));
+	memcpy(base + h->dense, pool->dense, h->slots_used * sizeof(uint32_t));
+	memcpy(base + h->generation, pool->generation, h->slots_used * sizeof(uint32_t));
+	memcpy(base + h->free, pool->free, h->free_count * sizeof(uint32_t));
+
+	/* oldest first, so restoring puts the ring back at tail 0 */
+	int16_t *x = (int16_t *)(base + h->trail_x), *y = (int16_t *)(base + h->trail_y);
+	uint8_t *age = (uint8_t *)(base + h->trail_age);
+	for (uint32_t i = 0; i < h->trail_count; i++) {
+		const uint32_t j = (t->tail + i) & TRAIL_MASK;
+		x[i] = t->x[j], y[i] = t->y[j], age[i] = t->age[j];
+	}
+
+	if (h->brick_words)
+		memcpy(base + h->bricks, ctx->bricks.bits, h->brick_words * sizeof(uint64_t));
+}
+
+/*
+ * an entity has to have a shape and a size that fit the field, span tables
+ * are built for it, and coordinates that turn into ints. positions outside
+ * the field are fine, the next move pulls them in.
+ */
+static bool snapshot_entity_valid(const snapshot_header_t *h, const entity_t *e) {
+	if (e->shape >= SHAPE_COUNT)
+		return false;
+
+	/* comparisons are false for nan, so each is written to fail on it */
+	if (!(e->size.x >= MIN_ENTITY_WIDTH && e->size.x <= h->width && e->size.y >= MIN_ENTITY_HEIGHT && e->size.y <= h->height))
+		return false;
+
+	return fabsl(e->pos.x) <= INT16_MAX && fabsl(e->pos.y) <= INT16_MAX
+		&& fabsl(e->delta.x) <= INT16_MAX && fabsl(e->delta.y) <= INT16_MAX;
+}
+
+static bool snapshot_valid(const snapshot_header_t *h, const size_t size) {
+	if (size < sizeof(*h) || h->magic != SNAPSHOT_MAGIC || h->version != SNAPSHOT_VERSION
+			|| h->entity_size != sizeof(entity_t) || h->f64_size != sizeof(f64))
+		return false;
+
+	if (h->width < 3 || h->height < 3 || h->width > INT16_MAX || h->height > INT16_MAX)
+		return false;
+
+	if (h->count > MAX_ENTITIES || h->slots_used > MAX_ENTITIES || h->count > h->slots_used
+			|| h->free_count != h->slots_used - h->count || h->trail_count > TRAIL_CAPACITY)
+		return false;
+
+	const uint64_t brick_words = (uint64_t)((h->width + 63) / 64) * h->height;
+	if (h->brick_words && h->brick_words != brick_words)
+		return false;
+
+	/* the offsets have to be the ones the counts give, which also keeps them inside the file */
+	snapshot_header_t layout = *h;
+	snapshot_layout(&layout);
+	if (memcmp(&layout, h, sizeof(layout)) || h->size > size)
+		return false;
+
+	if (!isfinite(h->pending_time))
+		return false;
+
+	const char *base = (const char *)h;
+	const entity_t *entities = (const entity_t *)(base + h->entities);
+	for (uint32_t i = 0; i < h->count; i++) {
+		if (!snapshot_entity_valid(h, &entities[i]))
+			return false;
+	}
+
+	const uint8_t *trail_age = (const uint8_t *)(base + h->trail_age);
+	for (uint32_t i = 0; i < h->trail_count; i++) {
+		if (trail_age[i] >= TRAIL_LIFETIME)
+			return false;
+	}
+
+	/*
+	 * and the pool's indices have to stay inside the pool: every live slot
+	 * points back at the entity that owns it, and the free slots are the
+	 * rest, each once
+	 */
+	const uint32_t *owner = (const uint32_t *)(base + h->owner), *dense = (const uint32_t *)(base + h->dense);
+	const uint32_t *free_slots = (const uint32_t *)(base + h->free);
+
+	for (uint32_t i = 0; i < h->count; i++) {
+		if (owner[i] >= h->slots_used || dense[owner[i]] != i)
+			return false;
+	}
+
+	uint64_t *taken = calloc((h->slots_used + 63) / 64 + 1, sizeof(uint64_t));
+	if (!taken)
+		return false;
+
+	for (uint32_t i = 0; i < h->count; i++)
+		taken[owner[i] >> 6] |= 1ULL << (owner[i] & 63);
+
+	bool ok = true;
+	for (uint32_t i = 0; ok && i < h->free_count; i++) {
+		const uint32_t slot = free_slots[i];
+		ok = slot < h->slots_used && !(taken[slot >> 6] & 1ULL << (slot & 63));
+		if (ok)
+			taken[slot >> 6] |= 1ULL << (slot & 63);
+	}
+
+	free(taken);
+	return ok;
+}
+
+static pong_ctx_t *snapshot_load(const snapshot_header_t *h, const char *base) {
+	pong_ctx_t *ctx = pong_new(h->width, h->height, 0);
+	if (!ctx)
+		return NULL;
+
+	entity_pool_t *pool = &ctx->pool;
+	trail_pool_t *t = &ctx->trails;
+
+	ctx->tick = h->tick;
+	ctx->pending_time = h->pending_time;
+	ctx->rng = h->rng;
+	ctx->tick_rate = h->tick_rate < PONG_MIN_FPS ? PONG_MIN_FPS : h->tick_rate > PONG_MAX_FPS ? PONG_MAX_FPS : h->tick_rate;
+	ctx->paused = h->flags & SNAPSHOT_PAUSED;
+	ctx->ball = h->ball;
+
+	pool->count = h->count;
+	pool->slots_used = h->slots_used;
+	pool->free_count = h->free_count;
+
+	memcpy(pool->entities, base + h->entities, h->count * sizeof(entity_t));
+	memcpy(pool->owner, base + h->owner, h->count * sizeof(uint32_t));
+	memcpy(pool->dense, base + h->dense, h->slots_used * sizeof(uint32_t));
+	memcpy(pool->generation, base + h->generation, h->slots_used * sizeof(uint32_t));
+	memcpy(pool->free, base + h->free, h->free_count * sizeof(uint32_t));
+
+	for (uint32_t i = 0; i < pool->count; i++) {
+		entity_t *e = &pool->entities[i];
+		if (!entity_reshape(ctx, e, e->shape, e->size)) {
+			pong_free(ctx);
+			return NULL;
+		}
+	}
+
+	memcpy(t->x, base + h->trail_x, h->trail_count * sizeof(int16_t));
+	memcpy(t->y, base + h->trail_y, h->trail_count * sizeof(int16_t));
+	memcpy(t->age, base + h->trail_age, h->trail_count * sizeof(uint8_t));
+	t->tail = 0;
+	t->head = h->trail_count;
+
+	ctx->trails_enabled = h->flags & SNAPSHOT_TRAILS;
+	ctx->background_gradient = h->flags & SNAPSHOT_GRADIENT;
+	ctx->fade_enabled = h->flags & SNAPSHOT_FADE;
+	ctx->antialiasing = h->flags & SNAPSHOT_ANTIALIASING;
+	ctx->monochrome_enabled = h->flags & SNAPSHOT_MONOCHROME;
+
+	if (h->flags & SNAPSHOT_BREAKOUT) {
+		if (!bricks_build(&ctx->bricks, ctx->width, ctx->height)) {
+			pong_free(ctx);
+			return NULL;
+		}
+
+		ctx->breakout_enabled = true;
+
+		if (h->brick_words) {
+			memcpy(ctx->bricks.bits, base + h->bricks, h->brick_words * sizeof(uint64_t));
+			ctx->bricks.count = h->brick_count;
+		}
+	}
+
+	ctx->scoreboard = (scoreboard_t){
+		.enabled = h->flags & SNAPSHOT_SCOREBOARD,
+		.dirty = true,
+		.left = h->score_left,
+		.right = h->score_right,
+	};
+
+	paint_background(ctx);
+	return ctx;
+}
+
+int pong_save(const pong_ctx_t *ctx, const char *path) {
+	const snapshot_header_t h = snapshot_header(ctx);
+
+	/* written next to it and renamed over, so a crash never leaves half a snapshot */
+	char tmp[4096];
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+		return errno = ENAMETOOLONG, -1;
+
+	const int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return -1;
+
+	char *base = MAP_FAILED;
+	if (!ftruncate(fd, h.size))
+		base = mmap(NULL, h.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if (base == MAP_FAILED) {
+		close(fd);
+		unlink(tmp);
+		return -1;
+	}
+
+	snapshot_fill(ctx, &h, base);
+	munmap(base, h.size);
+
+	/* closed whatever fsync says, and the first error is the one reported */
+	const bool synced = !fsync(fd);
+	const int err = errno;
+	const bool closed = !close(fd);
+	if (!synced)
+		errno = err;
+
+	if (!synced || !closed || rename(tmp, path)) {
+		const int failed = errno;
+		unlink(tmp);
+		return errno = failed, -1;
+	}
+
+	return 0;
+}
+
+pong_ctx_t *pong_restore(const char *path) {
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	struct stat st;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return NULL;
+	}
+
+	if ((size_t)st.st_size < sizeof(snapshot_header_t)) {
+		close(fd);
+		return errno = EINVAL, NULL;
+	}
+
+	const char *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return NULL;
+
+	const snapshot_header_t *h = (const snapshot_header_t *)base;
+	const bool valid = snapshot_valid(h, st.st_size);
+	pong_ctx_t *ctx = valid ? snapshot_load(h, base) : NULL;
+
+	/* a valid snapshot only fails to load for want of memory, errno says so */
+	munmap((void *)base, st.st_size);
+	if (!valid)
+		errno = EINVAL;
+
+	return ctx;
+}
+
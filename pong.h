@@ -0,0 +1,543 @@
+#ifndef PONG_H
+#define PONG_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pong_counters.h"
+
+/*
+ * the simulation and renderer, with no terminal and no globals. everything
+ * lives in a pong_ctx_t; step it, then render the changed cells as escape
+ * sequences into whatever buffer you like. nothing in here exits, calls
+ * that can run out of memory fail like syscalls, with errno, or make do
+ * as their comments say.
+ */
+
+typedef long double f64;
+
+typedef struct {
+	f64 x, y;
+} vec2;
+
+static inline vec2 vec2_new(const int x, const int y) {
+	return (vec2){ x, y };
+}
+
+static inline f64 vec2_len(const vec2 a) {
+	const f64 x = a.x;
+	const f64 y = a.y;
+
+	return sqrtl((x * x) + (y * y));
+}
+
+static inline vec2 vec2_add(const vec2 a, const vec2 b) {
+	return (vec2){ a.x + b.x, a.y + b.y };
+}
+
+static inline vec2 vec2_sub(const vec2 a, const vec2 b) {
+	return (vec2){ a.x - b.x, a.y - b.y };
+}
+
+static inline vec2 vec2_negate(const vec2 a) {
+	return (vec2){ -a.x, -a.y };
+}
+
+static inline vec2 vec2_rotate(const vec2 a, const f64 degrees) {
+	const f64 radians = degrees * M_PI/180;
+	return (vec2){
+		roundl(cosl(radians) * a.x - sinl(radians) * a.y),
+		roundl(sinl(radians) * a.x + cosl(radians) * a.y),
+	};
+}
+
+typedef struct {
+	uint8_t r, g, b;
+} rgb;
+
+static inline rgb rgb_new(const uint8_t r, const uint8_t g, const uint8_t b) {
+	return (rgb){ r, g, b };
+}
+
+static inline bool rgb_eq(const rgb a, const rgb b) {
+	return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+_Static_assert(sizeof(rgb) == 3, "rgb rows are blended as packed bytes");
+
+/* d + (s - d) * a / 255, rounded exactly */
+static inline uint8_t blend_u8(const uint8_t d, const uint8_t s, const uint8_t a) {
+	const uint16_t v = s * a + d * (0xFF - a) + 0x80;
+	return (v + (v >> 8)) >> 8;
+}
+
+static inline uint8_t add_u8(const uint8_t a, const uint8_t b) {
+	const unsigned v = a + b;
+	return v > 0xFF ? 0xFF : v;
+}
+
+static inline rgb rgb_blend(const rgb d, const rgb s, const uint8_t a) {
+	return (rgb){ blend_u8(d.r, s.r, a), blend_u8(d.g, s.g, a), blend_u8(d.b, s.b, a) };
+}
+
+static inline rgb rgb_add(const rgb a, const rgb b) {
+	return (rgb){ add_u8(a.r, b.r), add_u8(a.g, b.g), add_u8(a.b, b.b) };
+}
+
+static inline rgb rgb_scale(const rgb col, const uint8_t a) {
+	return (rgb){ blend_u8(0, col.r, a), blend_u8(0, col.g, a), blend_u8(0, col.b, a) };
+}
+
+/* rgb_blend and rgb_add over a row of n cells, sixteen bytes at a time */
+void rgb_blend_row(rgb *restrict dst, const rgb *restrict src, int n, uint8_t alpha);
+void rgb_add_row(rgb *restrict dst, const rgb *restrict src, int n);
+
+#define RGB(col)		(col).r, (col).g, (col).b
+#define WHITE			(rgb){ 0xFF, 0xFF, 0xFF }
+#define BLACK			(rgb){ 0, 0, 0 }
+
+
+typedef struct {
+	uint64_t s[4];
+} rng_t;
+
+/* seeds the rng, and anything else that has to come out the same each run */
+static inline uint64_t splitmix64(uint64_t *x) {
+	uint64_t z = (*x += 0x9E3779B97F4A7C15);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+	return z ^ (z >> 31);
+}
+
+
+typedef enum {
+	SHAPE_RECT,
+	SHAPE_CIRCLE,
+	SHAPE_SPRITE,
+	SHAPE_COUNT,
+} shape_t;
+
+typedef struct {
+	int16_t start;
+	int16_t len;
+} span_t;
+
+/*
+ * a shape rasterised for one size: row r covers spans[rows[r]] up to
+ * spans[rows[r + 1]], starts are relative to the entity's left edge.
+ * tables are built on first use and live as long as the context.
+ */
+typedef struct span_table {
+	shape_t shape;
+	int width;
+	int height;
+
+	uint32_t *rows;
+	span_t *spans;
+
+	struct span_table *next;
+} span_table_t;
+
+#define SPAN_CACHE_BUCKETS	256
+
+#define for_each_span(t, row, span) \
+	for (int row = 0; row < (t)->height; row++) \
+		for (const span_t *span = (t)->spans + (t)->rows[row]; span < (t)->spans + (t)->rows[row + 1]; span++)
+
+
+typedef struct {
+	vec2 pos;
+	vec2 delta;
+	vec2 size;
+
+	shape_t shape;
+	const span_table_t *spans;
+
+	uint8_t hits;
+} entity_t;
+
+enum {
+	WALL_LEFT	= 1 << 0,
+	WALL_RIGHT	= 1 << 1,
+	WALL_TOP	= 1 << 2,
+	WALL_BOTTOM	= 1 << 3,
+};
+
+#define MAX_ENTITIES		(1 << 17)
+
+typedef struct {
+	uint32_t index;
+	uint32_t generation;
+} entity_handle_t;
+
+/* what pong_add_entity hands back when it can't add one, it never resolves */
+#define ENTITY_HANDLE_NONE	(entity_handle_t){ UINT32_MAX, 0 }
+
+/*
+ * live entities are kept dense in `entities` so updates walk a flat array.
+ * handles name a slot; the slot maps to the entity's current dense index
+ * and its generation is bumped on despawn so stale handles stop resolving.
+ */
+typedef struct {
+	entity_t entities[MAX_ENTITIES];
+	uint32_t owner[MAX_ENTITIES];
+
+	uint32_t dense[MAX_ENTITIES];
+	uint32_t generation[MAX_ENTITIES];
+
+	uint32_t free[MAX_ENTITIES];
+	uint32_t free_count;
+
+	uint32_t slots_used;
+	uint32_t count;
+} entity_pool_t;
+
+
+#define TRAIL_CAPACITY	(1 << 16)
+#define TRAIL_LIFETIME	12
+
+/*
+ * every particle lives for the same number of ticks, so the ring is always
+ * ordered oldest to newest and expiring is just advancing the tail.
+ */
+typedef struct {
+	int16_t x[TRAIL_CAPACITY];
+	int16_t y[TRAIL_CAPACITY];
+	uint8_t age[TRAIL_CAPACITY];
+
+	uint32_t head;
+	uint32_t tail;
+} trail_pool_t;
+
+
+/*
+ * cells are indexed by terminal position, (1, 1) is cells[0]. only the
+ * playfield inside the border is ever drawn or presented.
+ * the backdrop is one row of the plain background, without anything that
+ * gets painted over it (bricks), to restore cells from.
+ *
+ * layers are composited front to back. cover is how much of a cell is
+ * still visible through what's been drawn so far (0xFF untouched, 0 hidden)
+ * and opaque has a bit set for every fully hidden cell, so anything drawn
+ * behind it is skipped a word at a time and never blended.
+ */
+typedef struct {
+	int width;
+	int height;
+	int words;
+
+	rgb *cells;
+	rgb *front;
+	rgb *background;
+	rgb *backdrop;
+	rgb *scratch;
+
+	uint8_t *cover;
+	uint64_t *opaque;
+
+	int capacity_width;
+	int capacity_height;
+
+	bool stale;
+} framebuffer_t;
+
+/*
+ * one bit per cell, laid out like the brick field so bricks can be copied
+ * straight in. changed runs are found by xoring against what's on screen
+ * and get sent as spaces with reverse video on or off.
+ */
+typedef struct {
+	int width;
+	int height;
+	int words;
+
+	uint64_t *bits;
+	uint64_t *front;
+
+	int capacity_width;
+	int capacity_height;
+
+	bool stale;
+} bitplane_t;
+
+/*
+ * one bit per terminal cell, laid out like the framebuffer. bricks are
+ * painted into the framebuffer background once and only the cells of
+ * destroyed bricks are restored afterwards.
+ */
+typedef struct {
+	int width;
+	int height;
+	int words;
+
+	uint64_t *bits;
+	uint32_t count;
+} brick_field_t;
+
+
+typedef struct {
+	char *data;
+	size_t len;
+	size_t cap;
+
+	uint64_t written;
+	size_t last_frame;
+} outbuf_t;
+
+#define RUN_CACHE_SIZE		1024
+#define RUN_MAX_CELLS		128
+#define RUN_MAX_SGR		sizeof("\033[48;2;255;255;255m")
+
+typedef struct {
+	rgb col;
+	uint8_t sgr_len;
+	uint16_t cells;
+	char data[RUN_MAX_SGR + RUN_MAX_CELLS];
+} encoded_run_t;
+
+
+typedef struct {
+	int x0, y0;
+	int x1, y1;
+} rect_t;
+
+#define SCORE_MAX_RECTS		512
+
+typedef struct {
+	bool enabled;
+	bool dirty;
+
+	uint32_t left;
+	uint32_t right;
+
+	rect_t rects[SCORE_MAX_RECTS];
+	int rect_count;
+} scoreboard_t;
+
+
+#define AA_SHIFT	8
+#define AA_ONE		(1 << AA_SHIFT)
+
+
+typedef enum {
+	PONG_SIZE,
+	PONG_DELTA,
+	PONG_SPAWN,
+	PONG_DESPAWN,
+	PONG_FPS,
+	PONG_PAUSE,
+	PONG_RESUME,
+} pong_op_t;
+
+typedef struct {
+	pong_op_t op;
+	double a, b;
+} pong_command_t;
+
+/*
+ * rewind history: every tick's state packed into an image and stored as
+ * the xor against a prediction of it from the tick before, zero runs and
+ * literals as varints, with a keyframe (each entity xored with the one
+ * before it) every REWIND_KEYFRAME ticks or whenever the layout changes.
+ * entries and their bytes are rings, the oldest keyframe's group is
+ * dropped to make room. `image` is the state of the newest entry, the base
+ * for the next delta.
+ */
+#define REWIND_BYTES		(8 << 20)
+#define REWIND_ENTRIES		(1 << 15)
+#define REWIND_KEYFRAME		64
+
+typedef struct {
+	uint64_t tick;
+	uint64_t offset;
+	uint32_t len;
+	uint32_t image_size;
+	bool keyframe;
+} rewind_entry_t;
+
+typedef struct {
+	bool enabled;
+
+	uint8_t *data;
+	uint64_t data_head;
+
+	rewind_entry_t *entries;
+	uint32_t head;
+	uint32_t tail;
+
+	uint8_t *image;
+	uint8_t *scratch;
+	uint8_t *packed;
+	size_t image_size;
+	size_t image_cap;
+} rewind_t;
+
+/*
+ * the next tick rendered ahead of its deadline, with what it takes to put
+ * things back: the state before it packed like a rewind image, the trail
+ * ring's ends, what was on screen and the counters.
+ */
+typedef struct {
+	bool active;
+	bool ticked;
+	bool committed;
+
+	uint8_t *image;
+	size_t image_size;
+	size_t image_cap;
+
+	rgb *front;
+	uint64_t *mono_front;
+	size_t front_cap;
+	size_t mono_front_cap;
+	bool stale;
+	bool mono_stale;
+
+	uint32_t trail_head;
+	uint32_t trail_tail;
+	size_t last_frame;
+
+	pong_counter_mark_t counters;
+} speculation_t;
+
+#define PONG_MIN_FPS		1
+#define PONG_MAX_FPS		1000
+#define PONG_DEFAULT_FPS	60
+
+typedef struct {
+	int width;
+	int height;
+
+	uint64_t tick;
+	int tick_rate;
+	double pending_time;
+	bool paused;
+
+	rng_t rng;
+	entity_pool_t pool;
+	entity_handle_t ball;
+
+	bool trails_enabled;
+	bool background_gradient;
+	bool fade_enabled;
+	bool antialiasing;
+	bool breakout_enabled;
+	bool monochrome_enabled;
+
+	trail_pool_t trails;
+	framebuffer_t framebuffer;
+	bitplane_t monochrome;
+	brick_field_t bricks;
+	scoreboard_t scoreboard;
+	rewind_t rewind;
+	speculation_t speculation;
+
+	span_table_t *span_cache[SPAN_CACHE_BUCKETS];
+	span_table_t digit_spans[10];
+	encoded_run_t run_cache[RUN_CACHE_SIZE];
+	rgb trail_fade[TRAIL_LIFETIME];
+	uint8_t aa_alpha[AA_ONE + 1];
+
+	uint32_t *aa_coverage;
+	int aa_coverage_cells;
+
+	outbuf_t output;
+	size_t output_sent;
+} pong_ctx_t;
+
+pong_ctx_t *pong_new(int width, int height, uint64_t seed);
+void pong_free(pong_ctx_t *ctx);
+
+/*
+ * entities are shrunk and pulled inside the new walls. broken bricks stay
+ * broken as far as the new field reaches, where it grows past the old one
+ * there are new bricks. fails at the old size if the new one doesn't fit
+ * in memory, an entity whose smaller shape doesn't just keeps its size.
+ */
+int pong_resize(pong_ctx_t *ctx, int width, int height);
+
+/* one simulation tick, or as many as fit into dt seconds at the tick rate */
+void pong_tick(pong_ctx_t *ctx);
+uint32_t pong_step(pong_ctx_t *ctx, double dt);
+
+/*
+ * composes a frame and encodes the cells that changed since the last one.
+ * if it doesn't fit into cap, the rest is handed out by the next calls
+ * before a new frame is started, see pong_render_pending. if the output
+ * buffer can't grow the frame stops after the last row it had room for,
+ * the rows after it are still out of date for the next one.
+ */
+size_t pong_render(pong_ctx_t *ctx, char *buf, size_t cap);
+size_t pong_render_pending(const pong_ctx_t *ctx);
+
+/*
+ * the two halves of pong_render: rasterising the frame, then diffing it
+ * against the last one and encoding the difference into ctx->output.
+ * encoding starts a new frame, whatever wasn't rendered yet is dropped.
+ */
+void pong_compose(pong_ctx_t *ctx);
+size_t pong_encode(pong_ctx_t *ctx);
+
+void pong_set_trails(pong_ctx_t *ctx, bool enabled);
+void pong_set_gradient(pong_ctx_t *ctx, bool enabled);
+void pong_set_fade(pong_ctx_t *ctx, bool enabled);
+void pong_set_antialiasing(pong_ctx_t *ctx, bool enabled);
+int pong_set_breakout(pong_ctx_t *ctx, bool enabled);
+void pong_set_scoreboard(pong_ctx_t *ctx, bool enabled);
+void pong_set_monochrome(pong_ctx_t *ctx, bool enabled);
+
+/* every entity that can be is changed, -1 if some couldn't */
+int pong_grow(pong_ctx_t *ctx);
+int pong_shrink(pong_ctx_t *ctx);
+int pong_next_shape(pong_ctx_t *ctx);
+int pong_speed_up(pong_ctx_t *ctx);
+int pong_slow_down(pong_ctx_t *ctx);
+
+/* ENTITY_HANDLE_NONE, with errno, when the pool is full or out of memory */
+entity_handle_t pong_add_entity(pong_ctx_t *ctx, entity_t e);
+entity_t *pong_get_entity(pong_ctx_t *ctx, entity_handle_t h);
+void pong_remove_entity(pong_ctx_t *ctx, entity_handle_t h);
+uint32_t pong_spawn(pong_ctx_t *ctx, uint32_t n);
+uint32_t pong_despawn(pong_ctx_t *ctx, uint32_t n);
+
+/*
+ * the whole simulation (entities, trails, bricks, modes, rng and tick) to
+ * a versioned snapshot file and back. restoring maps the file and copies
+ * the sections straight in, it's at the size it was saved at so call
+ * pong_resize if that's changed. both fail like syscalls, with errno.
+ */
+int pong_save(const pong_ctx_t *ctx, const char *path);
+pong_ctx_t *pong_restore(const char *path);
+
+/*
+ * records every tick from now on while enabled. seeking puts the state of
+ * a recorded tick back (trails are cleared) and forgets every tick after
+ * it, rewinding is seeking one tick back. both are false if the tick
+ * isn't in the history anymore. a tick there's no memory to record
+ * empties the history.
+ */
+int pong_set_rewind(pong_ctx_t *ctx, bool enabled);
+bool pong_seek(pong_ctx_t *ctx, uint64_t tick);
+bool pong_rewind(pong_ctx_t *ctx);
+
+/*
+ * runs the next tick and renders it into the output buffer ahead of time,
+ * once the last frame is all sent, for when nothing is going to change
+ * before then. committing keeps it, pong_render then just hands it out;
+ * discarding puts everything back as it was. nothing else may touch ctx in
+ * between. false, with nothing done, if there's no memory for the frame
+ * being put back.
+ */
+bool pong_speculate(pong_ctx_t *ctx);
+void pong_speculate_commit(pong_ctx_t *ctx);
+void pong_speculate_discard(pong_ctx_t *ctx);
+
+/* size W H | delta DX DY | spawn N | despawn N | fps N | pause | resume */
+bool pong_command_parse(const char *line, pong_command_t *cmd);
+int pong_command(pong_ctx_t *ctx, const pong_command_t *cmd);
+
+#endif
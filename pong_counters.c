@@ -0,0 +1,149 @@
+#include <pthread.h>
+#include <string.h>
+
+#ifdef __x86_64__
+#include <cpuid.h>
+#endif
+
+#include "pong_counters.h"
+
+const char *const pong_counter_names[PONG_COUNTER_COUNT] = {
+	[PONG_COUNTER_CELLS] = "cells",
+	[PONG_COUNTER_BYTES] = "bytes",
+	[PONG_COUNTER_COLLISIONS] = "collisions",
+	[PONG_COUNTER_EVENTS] = "events",
+};
+
+const char *const pong_timer_names[PONG_TIMER_COUNT] = {
+	[PONG_TIMER_TICK] = "tick",
+	[PONG_TIMER_COMPOSE] = "compose",
+	[PONG_TIMER_ENCODE] = "encode",
+};
+
+pong_clock_t pong_clock = { .tsc = false, .ns_per_tick = 1 };
+_Thread_local pong_counter_shard_t *pong_counter_shard;
+
+/*
+ * a thread's shard goes back on the free list when it exits, counts and
+ * all, and the next thread to attach carries on counting in it
+ */
+static pong_counter_shard_t shards[PONG_COUNTER_SHARDS];
+static uint32_t shards_used;
+static uint32_t shards_free[PONG_COUNTER_SHARDS];
+static uint32_t shards_free_count;
+static pthread_mutex_t shards_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t shard_key;
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static pthread_once_t calibrate_once = PTHREAD_ONCE_INIT;
+
+/*
+ * the tsc is sampled against the monotonic clock when the counters start
+ * and again when they're first read, which is usually long after, so
+ * nobody waits for it. only a read sooner than this waits out the rest.
+ */
+#define CALIBRATE_NS	10000000
+
+static uint64_t calibrate_ns0, calibrate_tsc0;
+
+static inline uint64_t monotonic_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* the tsc is only any good as a clock if it runs at a constant rate through p- and c-states */
+static bool tsc_invariant(void) {
+#ifdef __x86_64__
+	unsigned eax, ebx, ecx, edx;
+	if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+		return false;
+
+	__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+	return edx & (1 << 8);
+#else
+	return false;
+#endif
+}
+
+/* picks the clock, before the first sample is taken with it */
+static void clock_start(void) {
+#ifdef PONG_HAVE_TSC
+	if (!tsc_invariant())
+		return;
+
+	calibrate_ns0 = monotonic_ns();
+	calibrate_tsc0 = __rdtsc();
+	pong_clock.tsc = true;
+#endif
+}
+
+static void clock_calibrate(void) {
+#ifdef PONG_HAVE_TSC
+	if (!pong_clock.tsc)
+		return;
+
+	uint64_t ns1;
+	while ((ns1 = monotonic_ns()) - calibrate_ns0 < CALIBRATE_NS)
+		;
+	const uint64_t tsc1 = __rdtsc();
+
+	/* a tsc that went backwards is counted as if it ticked in ns */
+	if (tsc1 > calibrate_tsc0)
+		pong_clock.ns_per_tick = (double)(ns1 - calibrate_ns0) / (tsc1 - calibrate_tsc0);
+#endif
+}
+
+static void shard_detach(void *shard) {
+	pthread_mutex_lock(&shards_lock);
+	shards_free[shards_free_count++] = (pong_counter_shard_t *)shard - shards;
+	pthread_mutex_unlock(&shards_lock);
+
+	pong_counter_shard = NULL;
+}
+
+static void counters_init(void) {
+	shards[PONG_COUNTER_SHARDS - 1].shared = true;
+	pthread_key_create(&shard_key, shard_detach);
+	clock_start();
+}
+
+void pong_counters_init(void) {
+	pthread_once(&init_once, counters_init);
+}
+
+pong_counter_shard_t *pong_counters_attach(void) {
+	pong_counters_init();
+
+	pthread_mutex_lock(&shards_lock);
+	uint32_t i = PONG_COUNTER_SHARDS - 1;
+	if (shards_free_count)
+		i = shards_free[--shards_free_count];
+	else if (shards_used < PONG_COUNTER_SHARDS - 1)
+		i = shards_used++;
+	pthread_mutex_unlock(&shards_lock);
+
+	pong_counter_shard = &shards[i];
+	if (!pong_counter_shard->shared)
+		pthread_setspecific(shard_key, pong_counter_shard);
+
+	return pong_counter_shard;
+}
+
+void pong_counters_read(pong_counters_t *out) {
+	pong_counters_init();
+	pthread_once(&calibrate_once, clock_calibrate);
+	memset(out, 0, sizeof(*out));
+
+	for (int i = 0; i < PONG_COUNTER_SHARDS; i++) {
+		const pong_counter_shard_t *s = &shards[i];
+
+		for (int c = 0; c < PONG_COUNTER_COUNT; c++)
+			out->value[c] += __atomic_load_n(&s->value[c], __ATOMIC_RELAXED);
+
+		for (int t = 0; t < PONG_TIMER_COUNT; t++) {
+			out->timer_ns[t] += pong_clock_ns(__atomic_load_n(&s->timer_ticks[t], __ATOMIC_RELAXED));
+			out->timer_calls[t] += __atomic_load_n(&s->timer_calls[t], __ATOMIC_RELAXED);
+		}
+	}
+}
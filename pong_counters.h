@@ -0,0 +1,152 @@
+#ifndef PONG_COUNTERS_H
+#define PONG_COUNTERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PONG_HAVE_TSC	1
+#endif
+
+/*
+ * counters and timers for the hot paths. every thread gets its own
+ * cache-line padded shard on first use and is the only one writing to it,
+ * so a bump is a plain load and store with no lock and no false sharing.
+ * the shard is handed on when the thread exits. shards are only summed
+ * when someone asks. threads past the last shard, alive at the same time,
+ * share an overflow one and pay for an atomic add.
+ *
+ * timers count in ticks of pong_clock: the tsc when it's invariant,
+ * calibrated against CLOCK_MONOTONIC between the first use and the first
+ * read, otherwise CLOCK_MONOTONIC ns.
+ */
+typedef enum {
+	PONG_COUNTER_CELLS,
+	PONG_COUNTER_BYTES,
+	PONG_COUNTER_COLLISIONS,
+	PONG_COUNTER_EVENTS,
+	PONG_COUNTER_COUNT,
+} pong_counter_t;
+
+typedef enum {
+	PONG_TIMER_TICK,
+	PONG_TIMER_COMPOSE,
+	PONG_TIMER_ENCODE,
+	PONG_TIMER_COUNT,
+} pong_timer_t;
+
+#define PONG_COUNTER_SHARDS	64
+
+typedef struct {
+	_Alignas(64) uint64_t value[PONG_COUNTER_COUNT];
+	uint64_t timer_ticks[PONG_TIMER_COUNT];
+	uint64_t timer_calls[PONG_TIMER_COUNT];
+	bool shared;
+} pong_counter_shard_t;
+
+/* one thread's counts at some point, without the shard's padding */
+typedef struct {
+	uint64_t value[PONG_COUNTER_COUNT];
+	uint64_t timer_ticks[PONG_TIMER_COUNT];
+	uint64_t timer_calls[PONG_TIMER_COUNT];
+} pong_counter_mark_t;
+
+typedef struct {
+	uint64_t value[PONG_COUNTER_COUNT];
+	double timer_ns[PONG_TIMER_COUNT];
+	uint64_t timer_calls[PONG_TIMER_COUNT];
+} pong_counters_t;
+
+typedef struct {
+	bool tsc;
+	double ns_per_tick;
+} pong_clock_t;
+
+extern const char *const pong_counter_names[PONG_COUNTER_COUNT];
+extern const char *const pong_timer_names[PONG_TIMER_COUNT];
+
+extern pong_clock_t pong_clock;
+extern _Thread_local pong_counter_shard_t *pong_counter_shard;
+
+void pong_counters_init(void);
+pong_counter_shard_t *pong_counters_attach(void);
+void pong_counters_read(pong_counters_t *out);
+
+static inline uint64_t pong_clock_ticks(void) {
+#ifdef PONG_HAVE_TSC
+	if (pong_clock.tsc)
+		return __rdtsc();
+#endif
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline double pong_clock_ns(const uint64_t ticks) {
+	return ticks * pong_clock.ns_per_tick;
+}
+
+static inline pong_counter_shard_t *pong_counters_self(void) {
+	pong_counter_shard_t *s = pong_counter_shard;
+	return s ? s : pong_counters_attach();
+}
+
+static inline void pong_counter_bump(uint64_t *v, const uint64_t n, const bool shared) {
+	if (shared)
+		__atomic_fetch_add(v, n, __ATOMIC_RELAXED);
+	else
+		__atomic_store_n(v, *v + n, __ATOMIC_RELAXED);
+}
+
+static inline void pong_count(const pong_counter_t c, const uint64_t n) {
+	pong_counter_shard_t *s = pong_counters_self();
+	pong_counter_bump(&s->value[c], n, s->shared);
+}
+
+static inline uint64_t pong_timer_start(void) {
+	return pong_clock_ticks();
+}
+
+static inline void pong_timer_stop(const pong_timer_t t, const uint64_t start) {
+	const uint64_t end = pong_clock_ticks();
+	pong_counter_shard_t *s = pong_counters_self();
+
+	pong_counter_bump(&s->timer_ticks[t], end - start, s->shared);
+	pong_counter_bump(&s->timer_calls[t], 1, s->shared);
+}
+
+/*
+ * this thread's counts as they are now, and putting them back to that,
+ * for work that gets thrown away. on the shared shard it takes back
+ * whatever the other threads counted in between too.
+ */
+static inline void pong_counters_mark(pong_counter_mark_t *saved) {
+	const pong_counter_shard_t *s = pong_counters_self();
+
+	for (int c = 0; c < PONG_COUNTER_COUNT; c++)
+		saved->value[c] = __atomic_load_n(&s->value[c], __ATOMIC_RELAXED);
+	for (int t = 0; t < PONG_TIMER_COUNT; t++) {
+		saved->timer_ticks[t] = __atomic_load_n(&s->timer_ticks[t], __ATOMIC_RELAXED);
+		saved->timer_calls[t] = __atomic_load_n(&s->timer_calls[t], __ATOMIC_RELAXED);
+	}
+}
+
+static inline void pong_counter_reset(uint64_t *v, const uint64_t saved, const bool shared) {
+	pong_counter_bump(v, saved - __atomic_load_n(v, __ATOMIC_RELAXED), shared);
+}
+
+static inline void pong_counters_restore(const pong_counter_mark_t *saved) {
+	pong_counter_shard_t *s = pong_counters_self();
+
+	for (int c = 0; c < PONG_COUNTER_COUNT; c++)
+		pong_counter_reset(&s->value[c], saved->value[c], s->shared);
+	for (int t = 0; t < PONG_TIMER_COUNT; t++) {
+		pong_counter_reset(&s->timer_ticks[t], saved->timer_ticks[t], s->shared);
+		pong_counter_reset(&s->timer_calls[t], saved->timer_calls[t], s->shared);
+	}
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef PONG_FLIGHT_H
+#define PONG_FLIGHT_H
+
+#include <stdint.h>
+
+/*
+ * layout of the flight recorder dump. pong keeps the last
+ * PONG_FLIGHT_TICKS ticks in a ring that's always there, and when it
+ * dies, through die() or a fatal signal, the whole thing goes out with
+ * a single write. record head - 1 is the newest, a tick that was being
+ * recorded when the signal hit may be half written.
+ */
+#define PONG_FLIGHT_MAGIC	0x74686C66
+#define PONG_FLIGHT_VERSION	1
+
+#define PONG_FLIGHT_TICKS	1024
+
+typedef struct {
+	uint64_t tick;
+	uint64_t frame_ns;
+	uint32_t frame_bytes;
+	uint32_t entities;
+
+	float ball_x, ball_y;
+	float ball_dx, ball_dy;
+	float ball_w, ball_h;
+
+	uint16_t width, height;
+	uint8_t key;
+	uint8_t mode;
+	uint8_t commands;
+	uint8_t last_op;
+} pong_flight_record_t;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t capacity;
+
+	uint64_t head;
+
+	int32_t signal;
+	uint32_t pid;
+} pong_flight_header_t;
+
+typedef struct {
+	pong_flight_header_t header;
+	pong_flight_record_t records[PONG_FLIGHT_TICKS];
+} pong_flight_t;
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef PONG_SHM_H
+#define PONG_SHM_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * layout of the shared memory export (`pong -e /name`). the writer bumps seq
+ * to odd before touching anything and back to even when it's done, readers
+ * copy what they need and retry if seq was odd or changed under them.
+ * it's rewritten every frame, so only the first PONG_SHM_MAX_ENTITIES
+ * entities go in; entity_total says how many there are.
+ */
+#define PONG_SHM_MAGIC		0x676E6F70
+#define PONG_SHM_VERSION	2
+
+#define PONG_SHM_MAX_ENTITIES	(1 << 12)
+#define PONG_SHM_MAX_CELLS	(1 << 20)
+
+#define PONG_SHM_MONOCHROME	(1 << 0)
+
+typedef struct {
+	double x, y;
+	double dx, dy;
+	double w, h;
+} pong_shm_entity_t;
+
+typedef struct {
+	uint8_t r, g, b;
+} pong_shm_cell_t;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+
+	uint64_t seq;
+
+	uint64_t tick;
+	uint32_t flags;
+	uint32_t entity_count;
+	uint32_t entity_total;
+
+	uint32_t width;
+	uint32_t height;
+} pong_shm_header_t;
+
+typedef struct {
+	pong_shm_header_t header;
+
+	_Alignas(64) pong_shm_entity_t entities[PONG_SHM_MAX_ENTITIES];
+	pong_shm_cell_t cells[PONG_SHM_MAX_CELLS];
+} pong_shm_t;
+
+static inline uint64_t pong_shm_write_begin(pong_shm_t *shm) {
+	const uint64_t seq = shm->header.seq;
+
+	__atomic_store_n(&shm->header.seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	return seq + 2;
+}
+
+static inline void pong_shm_write_end(pong_shm_t *shm, const uint64_t seq) {
+	__atomic_store_n(&shm->header.seq, seq, __ATOMIC_RELEASE);
+}
+
+/*
+ * copies the header and up to max_entities/max_cells into the caller's
+ * buffers (either may be NULL), returns the tick of the snapshot.
+ */
+static inline uint64_t pong_shm_snapshot(const pong_shm_t *shm, pong_shm_header_t *header,
+		pong_shm_entity_t *entities, const uint32_t max_entities,
+		pong_shm_cell_t *cells, const uint32_t max_cells) {
+	for (;;) {
+		const uint64_t seq = __atomic_load_n(&shm->header.seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		memcpy(header, &shm->header, sizeof(*header));
+
+		const uint32_t n = header->entity_count < max_entities ? header->entity_count : max_entities;
+		if (entities && n)
+			memcpy(entities, shm->entities, n * sizeof(*entities));
+
+		const uint64_t cell_count = (uint64_t)header->width * header->height;
+		const uint32_t c = cell_count < max_cells ? cell_count : max_cells;
+		if (cells && c)
+			memcpy(cells, shm->cells, c * sizeof(*cells));
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&shm->header.seq, __ATOMIC_RELAXED) == seq)
+			return header->tick;
+	}
+}
+
+#endif
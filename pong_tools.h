@@ -0,0 +1,35 @@
+#ifndef PONG_TOOLS_H
+#define PONG_TOOLS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * the bits the game, the benchmarks, the scenario runner and the
+ * harnesses all need: a way out on errors the library hands back, a
+ * monotonic clock and a qsort comparison for sorting latencies. the
+ * seedable generator is pong.h's splitmix64.
+ */
+#define unreachable(func) \
+	do { fprintf(stderr, "unreachable (%s)\n", (func)); abort(); } while(0)
+
+#define die(fmt, ...) \
+	do { fprintf(stderr, fmt __VA_OPT__(,) __VA_ARGS__); fputc('\n', stderr); exit(1); } while(0)
+
+#define assert_ok(ret, fmt, ...) \
+	do { if (ret) { die(fmt __VA_OPT__(,) __VA_ARGS__); } } while(0)
+
+static inline uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline int compare_u64(const void *a, const void *b) {
+	const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+#endif
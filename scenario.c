@@ -0,0 +1,484 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "pong.h"
+#include "pong_tools.h"
+
+/*
+ * runs a scenario file against the engine and reports frame times and
+ * output bytes. a scenario is one directive per line, # starts a comment:
+ *
+ *   terminal W H		terminal size, 80 x 24 by default
+ *   seed N			seeds the engine and the entity distributions
+ *   ticks N			how long to run for
+ *   entities N [size W H] [delta DX DY] [shape rect|circle|sprite]
+ *				N more entities besides the ball. W, H, DX and DY
+ *				are a value or a range like 0.25-1, drawn uniformly,
+ *				deltas get a random sign
+ *   [at TICK] EVENT		EVENT at the start of tick TICK, or before the
+ *				first tick without `at`
+ *
+ * events are the control socket commands (size, delta, spawn, despawn, fps,
+ * pause, resume), the key commands grow, shrink, shape, faster and slower,
+ * `resize W H` and `enable`/`disable`/`toggle` of trails, gradient, fade,
+ * antialiasing, breakout, scoreboard, monochrome or rewind.
+ */
+#define SCENARIO_LINE_MAX	256
+#define SCENARIO_MAX_EVENTS	4096
+#define SCENARIO_MAX_SPAWNS	64
+
+typedef struct {
+	double min, max;
+} range_t;
+
+typedef struct {
+	uint32_t count;
+	range_t w, h;
+	range_t dx, dy;
+	shape_t shape;
+} spawn_t;
+
+typedef struct {
+	uint64_t tick;
+	char line[SCENARIO_LINE_MAX];
+} event_t;
+
+typedef struct {
+	int width, height;
+	uint64_t seed;
+	uint64_t ticks;
+
+	spawn_t spawns[SCENARIO_MAX_SPAWNS];
+	int spawn_count;
+
+	event_t events[SCENARIO_MAX_EVENTS];
+	int event_count;
+} scenario_t;
+
+static scenario_t scenario;
+
+static const char *const flag_names[] = {
+	"trails", "gradient", "fade", "antialiasing", "breakout", "scoreboard", "monochrome", "rewind",
+};
+
+#define FLAG_COUNT	(int)(sizeof(flag_names) / sizeof(flag_names[0]))
+
+static bool *flag_of(pong_ctx_t *ctx, const int flag) {
+	switch (flag) {
+	case 0: return &ctx->trails_enabled;
+	case 1: return &ctx->background_gradient;
+	case 2: return &ctx->fade_enabled;
+	case 3: return &ctx->antialiasing;
+	case 4: return &ctx->breakout_enabled;
+	case 5: return &ctx->scoreboard.enabled;
+	case 6: return &ctx->monochrome_enabled;
+	case 7: return &ctx->rewind.enabled;
+	default: unreachable("flag_of");
+	}
+}
+
+static void flag_set(pong_ctx_t *ctx, const int flag, const bool enabled) {
+	switch (flag) {
+	case 0: pong_set_trails(ctx, enabled); break;
+	case 1: pong_set_gradient(ctx, enabled); break;
+	case 2: pong_set_fade(ctx, enabled); break;
+	case 3: pong_set_antialiasing(ctx, enabled); break;
+	case 4: assert_ok(pong_set_breakout(ctx, enabled), "couldn't build the bricks"); break;
+	case 5: pong_set_scoreboard(ctx, enabled); break;
+	case 6: pong_set_monochrome(ctx, enabled); break;
+	case 7: assert_ok(pong_set_rewind(ctx, enabled), "couldn't make room for rewinding"); break;
+	default: unreachable("flag_set");
+	}
+}
+
+static int flag_find(const char *name) {
+	for (int i = 0; i < FLAG_COUNT; i++) {
+		if (!strcmp(name, flag_names[i]))
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * applies one event to ctx, or with ctx NULL only checks that it parses.
+ * returns false for anything it doesn't understand.
+ */
+static bool event_apply(pong_ctx_t *ctx, const char *line) {
+	char op[16], arg[16];
+	int w, h;
+
+	if (sscanf(line, "%15s", op) != 1)
+		return false;
+
+	if (!strcmp(op, "resize")) {
+		if (sscanf(line, "%*s %d %d", &w, &h) != 2 || w < 3 || h < 3)
+			return false;
+		if (ctx)
+			assert_ok(pong_resize(ctx, w, h), "couldn't resize to %dx%d", w, h);
+		return true;
+	}
+
+	if (!strcmp(op, "enable") || !strcmp(op, "disable") || !strcmp(op, "toggle")) {
+		if (sscanf(line, "%*s %15s", arg) != 1)
+			return false;
+
+		const int flag = flag_find(arg);
+		if (flag < 0)
+			return false;
+
+		if (ctx)
+			flag_set(ctx, flag, op[0] == 'e' ? true : op[0] == 'd' ? false : !*flag_of(ctx, flag));
+		return true;
+	}
+
+	static const struct {
+		const char *name;
+		int (*apply)(pong_ctx_t *);
+	} keys[] = {
+		{ "grow", pong_grow },
+		{ "shrink", pong_shrink },
+		{ "shape", pong_next_shape },
+		{ "faster", pong_speed_up },
+		{ "slower", pong_slow_down },
+	};
+
+	for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+		if (strcmp(op, keys[i].name))
+			continue;
+
+		if (ctx)
+			assert_ok(keys[i].apply(ctx), "couldn't apply %s", op);
+		return true;
+	}
+
+	pong_command_t cmd;
+	if (!pong_command_parse(line, &cmd))
+		return false;
+
+	if (ctx)
+		assert_ok(pong_command(ctx, &cmd), "couldn't apply %s", op);
+	return true;
+}
+
+static bool parse_range(const char *s, range_t *r) {
+	const int n = sscanf(s, "%lf-%lf", &r->min, &r->max);
+	if (n == 1)
+		r->max = r->min;
+
+	return n >= 1 && r->min <= r->max;
+}
+
+static bool parse_spawn(char *args, spawn_t *sp) {
+	*sp = (spawn_t){
+		.w = { 2, 2 }, .h = { 1, 1 },
+		.dx = { 0.25, 1 }, .dy = { 0.25, 1 },
+		.shape = SHAPE_RECT,
+	};
+
+	char *save;
+	char *tok = strtok_r(args, " \t", &save);
+	if (!tok || sscanf(tok, "%u", &sp->count) != 1)
+		return false;
+
+	while ((tok = strtok_r(NULL, " \t", &save))) {
+		char *a = strtok_r(NULL, " \t", &save);
+		if (!a)
+			return false;
+
+		if (!strcmp(tok, "shape")) {
+			static const char *const shapes[SHAPE_COUNT] = { "rect", "circle", "sprite" };
+
+			int s = 0;
+			while (s < SHAPE_COUNT && strcmp(a, shapes[s]))
+				s++;
+			if (s == SHAPE_COUNT)
+				return false;
+
+			sp->shape = s;
+			continue;
+		}
+
+		char *b = strtok_r(NULL, " \t", &save);
+		if (!b)
+			return false;
+
+		if (!strcmp(tok, "size")) {
+			if (!parse_range(a, &sp->w) || !parse_range(b, &sp->h) || sp->w.min < 1 || sp->h.min < 1)
+				return false;
+		} else if (!strcmp(tok, "delta")) {
+			if (!parse_range(a, &sp->dx) || !parse_range(b, &sp->dy))
+				return false;
+		} else {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void scenario_load(scenario_t *sc, const char *path) {
+	FILE *f = fopen(path, "r");
+	assert_ok(!f, "couldn't open scenario %s", path);
+
+	*sc = (scenario_t){ .width = 80, .height = 24, .seed = 1, .ticks = 600 };
+
+	char buf[SCENARIO_LINE_MAX];
+	for (int n = 1; fgets(buf, sizeof(buf), f); n++) {
+		char *line = buf;
+		line[strcspn(line, "#\r\n")] = '\0';
+		line += strspn(line, " \t");
+		if (!*line)
+			continue;
+
+		unsigned long long v;
+		uint64_t tick = 0;
+		int skip = 0;
+
+		if (sscanf(line, "terminal %d %d", &sc->width, &sc->height) == 2) {
+			assert_ok(sc->width < 3 || sc->height < 3, "%s:%d: terminal too small", path, n);
+			continue;
+		}
+		if (sscanf(line, "seed %llu", &v) == 1) {
+			sc->seed = v;
+			continue;
+		}
+		if (sscanf(line, "ticks %llu", &v) == 1) {
+			sc->ticks = v;
+			continue;
+		}
+		if (!strncmp(line, "entities", 8)) {
+			assert_ok(sc->spawn_count == SCENARIO_MAX_SPAWNS, "%s:%d: too many entities lines", path, n);
+			assert_ok(!parse_spawn(line + 8, &sc->spawns[sc->spawn_count++]), "%s:%d: bad entities line", path, n);
+			continue;
+		}
+
+		if (sscanf(line, "at %llu %n", &v, &skip) == 1 && skip) {
+			tick = v;
+			line += skip;
+		}
+
+		assert_ok(sc->event_count == SCENARIO_MAX_EVENTS, "%s:%d: too many events", path, n);
+		assert_ok(!event_apply(NULL, line), "%s:%d: unknown event: %s", path, n, line);
+		assert_ok(sc->event_count && tick < sc->events[sc->event_count - 1].tick,
+				"%s:%d: events have to be in tick order", path, n);
+
+		event_t *e = &sc->events[sc->event_count++];
+		e->tick = tick;
+		snprintf(e->line, sizeof(e->line), "%s", line);
+	}
+
+	fclose(f);
+}
+
+static inline double draw(uint64_t *state, const range_t r) {
+	return r.min + (splitmix64(state) >> 11) * 0x1.0p-53 * (r.max - r.min);
+}
+
+static void scenario_spawn(const scenario_t *sc, pong_ctx_t *ctx) {
+	uint64_t state = sc->seed;
+
+	for (int s = 0; s < sc->spawn_count; s++) {
+		const spawn_t *sp = &sc->spawns[s];
+
+		for (uint32_t i = 0; i < sp->count && ctx->pool.count < MAX_ENTITIES; i++) {
+			const vec2 size = { floor(draw(&state, sp->w)), floor(draw(&state, sp->h)) };
+			const uint64_t signs = splitmix64(&state);
+
+			const entity_handle_t e = pong_add_entity(ctx, (entity_t){
+				.pos = {
+					1 + floor(draw(&state, (range_t){ 0, fmax(ctx->width - 2 - size.x, 0) })),
+					1 + floor(draw(&state, (range_t){ 0, fmax(ctx->height - 2 - size.y, 0) })),
+				},
+				.size = size,
+				.delta = {
+					(signs & 1 ? -1 : 1) * draw(&state, sp->dx),
+					(signs & 2 ? -1 : 1) * draw(&state, sp->dy),
+				},
+				.shape = sp->shape,
+			});
+			assert_ok(!pong_get_entity(ctx, e), "couldn't add an entity");
+		}
+	}
+}
+
+/* the terminal end of pty mode, it only has to keep the pty from filling up */
+typedef struct {
+	int master;
+	int slave;
+	pthread_t drain;
+	uint64_t read;
+} pty_t;
+
+static void *pty_drain(void *arg) {
+	pty_t *p = arg;
+	char buf[1 << 16];
+
+	for (ssize_t n; (n = read(p->master, buf, sizeof(buf))) > 0;)
+		p->read += n;
+
+	return NULL;
+}
+
+static void pty_resize(const pty_t *p, const int width, const int height) {
+	const struct winsize ws = { .ws_row = height, .ws_col = width };
+	assert_ok(ioctl(p->slave, TIOCSWINSZ, &ws), "couldn't set pty size");
+}
+
+static void pty_open(pty_t *p, const int width, const int height) {
+	p->master = posix_openpt(O_RDWR | O_NOCTTY);
+	assert_ok(p->master < 0 || grantpt(p->master) || unlockpt(p->master), "couldn't open a pty");
+
+	p->slave = open(ptsname(p->master), O_RDWR | O_NOCTTY);
+	assert_ok(p->slave < 0, "couldn't open the pty slave");
+
+	struct termios attr;
+	assert_ok(tcgetattr(p->slave, &attr), "couldn't get pty attributes");
+	cfmakeraw(&attr);
+	assert_ok(tcsetattr(p->slave, TCSANOW, &attr), "couldn't set pty attributes");
+
+	pty_resize(p, width, height);
+	assert_ok(pthread_create(&p->drain, NULL, pty_drain, p), "couldn't start the pty reader");
+}
+
+static void pty_write(const pty_t *p, const char *buf, size_t len) {
+	while (len) {
+		const ssize_t n = write(p->slave, buf, len);
+		assert_ok(n < 0, "couldn't write to the pty");
+
+		buf += n;
+		len -= n;
+	}
+}
+
+static void pty_close(pty_t *p) {
+	close(p->slave);
+	pthread_join(p->drain, NULL);
+	close(p->master);
+}
+
+static void usage(const char *prog) {
+	die("usage: %s [-p] [-r] [-s snapshot] scenario", prog);
+}
+
+int main(int argc, char **argv) {
+	bool on_pty = false;
+	bool real_time = false;
+	const char *snapshot = NULL;
+
+	for (int opt; (opt = getopt(argc, argv, "prs:")) != -1;) {
+		switch (opt) {
+		case 'p': on_pty = true; break;
+		case 'r': real_time = true; break;
+		case 's': snapshot = optarg; break;
+		default: usage(argv[0]);
+		}
+	}
+
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	scenario_t *sc = &scenario;
+	scenario_load(sc, argv[optind]);
+
+	/* with a snapshot the setup is done once and every later run maps it back in */
+	const uint64_t setup_start = now_ns();
+	pong_ctx_t *ctx = snapshot ? pong_restore(snapshot) : NULL;
+	const bool restored = ctx;
+
+	if (!ctx) {
+		assert_ok(snapshot && errno != ENOENT, "couldn't restore %s", snapshot);
+
+		ctx = pong_new(sc->width, sc->height, sc->seed);
+		assert_ok(!ctx, "couldn't create a %dx%d field", sc->width, sc->height);
+		scenario_spawn(sc, ctx);
+
+		if (snapshot)
+			assert_ok(pong_save(ctx, snapshot), "couldn't save %s", snapshot);
+	}
+
+	const uint64_t setup_ns = now_ns() - setup_start;
+
+	pty_t pty = { 0 };
+	if (on_pty)
+		pty_open(&pty, sc->width, sc->height);
+
+	uint64_t *frame_ns = calloc(sc->ticks ? sc->ticks : 1, sizeof(uint64_t));
+	assert_ok(!frame_ns, "out of memory");
+
+	static char frame[1 << 16];
+	uint64_t bytes = 0;
+	int next = 0;
+
+	const uint64_t start = now_ns();
+	uint64_t deadline = start;
+
+	for (uint64_t tick = 0; tick < sc->ticks; tick++) {
+		const uint64_t frame_start = now_ns();
+
+		for (; next < sc->event_count && sc->events[next].tick <= tick; next++) {
+			event_apply(ctx, sc->events[next].line);
+			if (on_pty && !strncmp(sc->events[next].line, "resize", 6))
+				pty_resize(&pty, ctx->width, ctx->height);
+		}
+
+		pong_tick(ctx);
+
+		do {
+			const size_t n = pong_render(ctx, frame, sizeof(frame));
+			if (on_pty)
+				pty_write(&pty, frame, n);
+			bytes += n;
+		} while (pong_render_pending(ctx));
+
+		frame_ns[tick] = now_ns() - frame_start;
+
+		if (real_time) {
+			deadline += 1000000000 / ctx->tick_rate;
+
+			const struct timespec ts = { deadline / 1000000000, deadline % 1000000000 };
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+				;
+		}
+	}
+
+	const uint64_t elapsed = now_ns() - start;
+
+	if (on_pty)
+		pty_close(&pty);
+
+	qsort(frame_ns, sc->ticks, sizeof(uint64_t), compare_u64);
+
+	uint64_t total = 0;
+	for (uint64_t i = 0; i < sc->ticks; i++)
+		total += frame_ns[i];
+
+	const uint64_t ticks = sc->ticks ? sc->ticks : 1;
+
+	printf("%s: %lu ticks, %u entities, %d x %d, %s%s\n", argv[optind],
+			(unsigned long)sc->ticks, ctx->pool.count, ctx->width, ctx->height,
+			on_pty ? "pty" : "headless", real_time ? ", real time" : "");
+	printf("  setup %.3f ms%s\n", setup_ns / 1e6,
+			restored ? ", restored" : snapshot ? ", saved" : "");
+	printf("  %.3f s, %.1f ticks/s\n", elapsed / 1e9, sc->ticks * 1e9 / elapsed);
+	printf("  frame ns: mean %lu p50 %lu p99 %lu max %lu\n",
+			(unsigned long)(total / ticks),
+			(unsigned long)frame_ns[sc->ticks / 2],
+			(unsigned long)frame_ns[sc->ticks * 99 / 100],
+			(unsigned long)frame_ns[ticks - 1]);
+	printf("  bytes: %lu total, %lu per frame\n", (unsigned long)bytes, (unsigned long)(bytes / ticks));
+
+	free(frame_ns);
+	pong_free(ctx);
+}
@@ -0,0 +1,50 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "pong_shm.h"
+
+#define die(fmt, ...) \
+	do { fprintf(stderr, fmt __VA_OPT__(,) __VA_ARGS__); fputc('\n', stderr); exit(1); } while(0)
+
+#define assert_ok(ret, fmt, ...) \
+	do { if (ret) { die(fmt __VA_OPT__(,) __VA_ARGS__); } } while(0)
+
+/* prints snapshots of a running `pong -e /name` */
+int main(int argc, char **argv) {
+	if (argc < 2)
+		die("usage: %s /shm-name [count] [interval-ms]", argv[0]);
+
+	const int count = argc > 2 ? atoi(argv[2]) : 1;
+	const int interval = argc > 3 ? atoi(argv[3]) : 100;
+
+	const int fd = shm_open(argv[1], O_RDONLY, 0);
+	assert_ok(fd < 0, "couldn't open shared memory %s", argv[1]);
+
+	const pong_shm_t *shm = mmap(NULL, sizeof(pong_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+	assert_ok(shm == MAP_FAILED, "couldn't map shared memory %s", argv[1]);
+	close(fd);
+
+	assert_ok(shm->header.magic != PONG_SHM_MAGIC || shm->header.version != PONG_SHM_VERSION,
+			"%s isn't a pong export (version %d)", argv[1], PONG_SHM_VERSION);
+
+	for (int i = 0; i < count; i++) {
+		pong_shm_header_t header;
+		pong_shm_entity_t first;
+
+		pong_shm_snapshot(shm, &header, &first, 1, NULL, 0);
+
+		printf("tick %lu entities %u (%u exported) display %u x %u%s",
+				(unsigned long)header.tick, header.entity_total, header.entity_count,
+				header.width, header.height,
+				header.flags & PONG_SHM_MONOCHROME ? " (monochrome)" : "");
+		if (header.entity_count)
+			printf(" first (%.3f, %.3f) delta (%.3f, %.3f)", first.x, first.y, first.dx, first.dy);
+		putchar('\n');
+
+		if (i + 1 < count)
+			usleep(interval * 1000);
+	}
+}